@@ -0,0 +1,113 @@
+#ifndef LINE_FRAMER_HPP
+#define LINE_FRAMER_HPP
+
+#include <string_view>
+#include <memory>
+#include <cstring>
+#include <cstddef>
+
+// Размер буфера по умолчанию: с запасом больше самой длинной строки
+#define LINE_FRAMER_CAPACITY 65536
+
+// Нарезка потока байт из порта на строки без копирования и аллокаций.
+// Данные читаются прямо в буфер (writePtr/commit), строки отдаются как
+// string_view на этот же буфер. Хвост неполной строки сдвигается в начало
+// буфера только перед следующим чтением, поэтому работа линейна по объему.
+//
+//     size_t n = 0;
+//     port.Read(framer.writePtr(), framer.writable(), &n);
+//     framer.commit(n);
+//     std::string_view line;
+//     while (framer.next(line)) { ... }
+//
+// Строка действительна до следующего вызова writePtr()
+class LineFramer {
+public:
+    explicit LineFramer(size_t capacity = LINE_FRAMER_CAPACITY)
+        : buffer(new char[capacity]), capacity(capacity),
+          begin(0), scanned(0), end(0), discarding(false) {}
+
+    // Куда дописывать новые данные
+    char* writePtr() {
+        compact();
+        return buffer.get() + end;
+    }
+
+    // Сколько байт можно дописать
+    size_t writable() {
+        compact();
+        return capacity - end;
+    }
+
+    // Фиксируем n байт, записанных по writePtr()
+    void commit(size_t n) {
+        end += n;
+    }
+
+    // Следующая непустая строка без пробельных символов по краям.
+    // false - полных строк больше нет, нужно дочитать данные
+    bool next(std::string_view& line) {
+        for (;;) {
+            const char* base = buffer.get();
+            const void* found = memchr(base + scanned, '\n', end - scanned);
+            if (!found) {
+                scanned = end;
+                // Строка длиннее буфера - выбрасываем ее до конца
+                if (begin == 0 && end == capacity) {
+                    begin = scanned = end = 0;
+                    discarding = true;
+                }
+                return false;
+            }
+
+            size_t pos = static_cast<const char*>(found) - base;
+            size_t line_begin = begin;
+            begin = scanned = pos + 1;
+
+            if (discarding) {
+                discarding = false;
+                continue;
+            }
+
+            size_t line_end = pos;
+            while (line_begin < line_end && isSpace(base[line_begin])) ++line_begin;
+            while (line_end > line_begin && isSpace(base[line_end - 1])) --line_end;
+
+            if (line_begin == line_end) continue;
+
+            line = std::string_view(base + line_begin, line_end - line_begin);
+            return true;
+        }
+    }
+
+    // Сколько байт неполной строки ждет продолжения
+    size_t pending() const {
+        return end - begin;
+    }
+
+private:
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    // Переносим хвост неполной строки в начало буфера
+    void compact() {
+        if (begin == 0) return;
+        memmove(buffer.get(), buffer.get() + begin, end - begin);
+        end -= begin;
+        scanned -= begin;
+        begin = 0;
+    }
+
+    std::unique_ptr<char[]> buffer;
+    const size_t capacity;
+    size_t begin;     // начало необработанных данных
+    size_t scanned;   // до куда уже искали '\n'
+    size_t end;       // конец записанных данных
+    bool discarding;  // пропускаем остаток слишком длинной строки
+
+    LineFramer(const LineFramer&);
+    LineFramer& operator=(const LineFramer&);
+};
+
+#endif
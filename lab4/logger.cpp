@@ -2,6 +2,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <chrono>
 #include <ctime>
@@ -17,6 +18,7 @@
 #include <sys/stat.h> 
 
 #include "my_serial.hpp"
+#include "line_framer.hpp"
 
 using namespace cplib;
 using namespace std;
@@ -64,21 +66,21 @@ private:
     mutex data_mutex;
     mutex file_mutex;
     
-    bool parse_json(const string& json_str, TemperatureData& data) {
+    bool parse_json(string_view json_str, TemperatureData& data) {
         size_t temp_pos = json_str.find("\"temperature\":");
         size_t checksum_pos = json_str.find("\"checksum\":");
         size_t time_pos = json_str.find("\"timestamp\":");
         
-        if (temp_pos == string::npos || checksum_pos == string::npos || time_pos == string::npos) {
+        if (temp_pos == string_view::npos || checksum_pos == string_view::npos || time_pos == string_view::npos) {
             return false;
         }
         
         // Извлекаем температуру
         temp_pos += 14; // Длина "\"temperature\":"
         size_t temp_end = json_str.find(',', temp_pos);
-        if (temp_end == string::npos) return false;
+        if (temp_end == string_view::npos) return false;
         
-        string temp_str = json_str.substr(temp_pos, temp_end - temp_pos);
+        string temp_str(json_str.substr(temp_pos, temp_end - temp_pos));
         float temperature;
         try {
             temperature = stof(temp_str);
@@ -89,12 +91,12 @@ private:
         // Извлекаем контрольную сумму
         checksum_pos += 11; // Длина "\"checksum\":"
         size_t checksum_end = json_str.find('}', checksum_pos);
-        if (checksum_end == string::npos) {
+        if (checksum_end == string_view::npos) {
             checksum_end = json_str.find(',', checksum_pos);
         }
-        if (checksum_end == string::npos) return false;
+        if (checksum_end == string_view::npos) return false;
         
-        string checksum_str = json_str.substr(checksum_pos, checksum_end - checksum_pos);
+        string checksum_str(json_str.substr(checksum_pos, checksum_end - checksum_pos));
         float checksum;
         try {
             checksum = stof(checksum_str);
@@ -112,9 +114,9 @@ private:
         // Извлекаем timestamp
         time_pos += 13; // Длина "\"timestamp\":"
         size_t time_end = json_str.find('"', time_pos + 1);
-        if (time_end == string::npos) return false;
+        if (time_end == string_view::npos) return false;
         
-        data.timestamp = json_str.substr(time_pos + 1, time_end - time_pos - 1);
+        data.timestamp = string(json_str.substr(time_pos + 1, time_end - time_pos - 1));
         data.temperature = temperature;
         
         return true;
@@ -446,7 +448,7 @@ public:
     }
     
     // Парсер джейсончика
-    bool parse_and_add_data(const string& json_str) {
+    bool parse_and_add_data(string_view json_str) {
         TemperatureData data;
         if (parse_json(json_str, data)) {
             add_data(data);
@@ -457,22 +459,18 @@ public:
 };
 
 void read_from_port(SerialPort& port, TemperatureLogger& logger) {
-    string buffer;
-    char read_buf[1024];
+    LineFramer framer;
     
     while (g_running) {
         size_t bytes_read = 0;
-        int result = port.Read(read_buf, sizeof(read_buf) - 1, &bytes_read);
+        int result = port.Read(framer.writePtr(), framer.writable(), &bytes_read);
         
         if (result == SerialPort::RE_OK && bytes_read > 0) {
-            read_buf[bytes_read] = '\0';
-            buffer += read_buf;
+            framer.commit(bytes_read);
 
-            size_t pos = 0;
-            while ((pos = buffer.find("}\r\n")) != string::npos) {
-                string json_str = buffer.substr(0, pos + 1);
-                buffer.erase(0, pos + 3); // +3 для "}\r\n"
-                
+            // Строки эмулятора заканчиваются "}\r\n", '\r' срезается при нарезке
+            string_view json_str;
+            while (framer.next(json_str)) {
                 if (logger.parse_and_add_data(json_str)) {
                     cout << "Received data\n";
                 } else {
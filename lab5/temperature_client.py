@@ -14,22 +14,63 @@ app = Flask(__name__)
 
 # Конфигурация сервера
 SERVER_URL = "http://localhost:8080"
+# Датчик, замеры которого показываем (у сервера их может быть несколько)
+SENSOR_ID = 0
 UPDATE_INTERVAL = 5
+ETAG_CACHE_SIZE = 64
 
 
 class TemperatureClient:
-    def __init__(self, server_url):
+    def __init__(self, server_url, sensor_id=SENSOR_ID):
         self.server_url = server_url
+        self.sensor_id = sensor_id
         self.current_temp = 0.0
         self.history = []
         self.max_history = 100
         self.lock = threading.Lock()
+        # Соединение держим в каждом потоке свое (Session не потокобезопасна),
+        # ответы по ETag общие: (path, params) -> (etag, json)
+        self.local = threading.local()
+        self.etag_cache = {}
+        self.etag_lock = threading.Lock()
+    
+    def _session(self):
+        session = getattr(self.local, 'session', None)
+        if session is None:
+            session = self.local.session = requests.Session()
+        return session
+    
+    def _get(self, path, params=None, timeout=5):
+        # Все запросы - к одному датчику
+        params = dict(params or {}, sensor=self.sensor_id)
+        key = (path, tuple(sorted(params.items())))
+        with self.etag_lock:
+            cached = self.etag_cache.get(key)
+        
+        headers = {'If-None-Match': cached[0]} if cached else {}
+        response = self._session().get(f"{self.server_url}{path}", params=params,
+                                    headers=headers, timeout=timeout)
+        
+        # Данные не изменились - отдаем сохраненный ответ
+        if response.status_code == 304 and cached:
+            return cached[1]
+        if response.status_code != 200:
+            return None
+        
+        data = response.json()
+        etag = response.headers.get('ETag')
+        if etag:
+            with self.etag_lock:
+                self.etag_cache.pop(key, None)
+                if len(self.etag_cache) >= ETAG_CACHE_SIZE:
+                    self.etag_cache.pop(next(iter(self.etag_cache)))
+                self.etag_cache[key] = (etag, data)
+        return data
         
     def fetch_current_temperature(self):
         try:
-            response = requests.get(f"{self.server_url}/api/current", timeout=2)
-            if response.status_code == 200:
-                data = response.json()
+            data = self._get("/api/current", timeout=2)
+            if data is not None:
                 return data.get('temperature', 0.0)
         except Exception as e:
             print(f"Error fetching temperature: {e}")
@@ -41,9 +82,7 @@ class TemperatureClient:
                 'start': start_time,
                 'end': end_time
             }
-            response = requests.get(f"{self.server_url}/api/statistics", params=params, timeout=5)
-            if response.status_code == 200:
-                return response.json()
+            return self._get("/api/statistics", params)
         except Exception as e:
             print(f"Error fetching statistics: {e}")
         return None
@@ -55,9 +94,7 @@ class TemperatureClient:
                 'end': end_time,
                 'limit': limit
             }
-            response = requests.get(f"{self.server_url}/api/raw", params=params, timeout=5)
-            if response.status_code == 200:
-                return response.json()
+            return self._get("/api/raw", params)
         except Exception as e:
             print(f"Error fetching raw data: {e}")
         return None
@@ -68,9 +105,7 @@ class TemperatureClient:
                 'start': start_date,
                 'end': end_date
             }
-            response = requests.get(f"{self.server_url}/api/hourly", params=params, timeout=5)
-            if response.status_code == 200:
-                return response.json()
+            return self._get("/api/hourly", params)
         except Exception as e:
             print(f"Error fetching hourly data: {e}")
         return None
@@ -81,32 +116,51 @@ class TemperatureClient:
                 'start': start_date,
                 'end': end_date
             }
-            response = requests.get(f"{self.server_url}/api/daily", params=params, timeout=5)
-            if response.status_code == 200:
-                return response.json()
+            return self._get("/api/daily", params)
         except Exception as e:
             print(f"Error fetching daily data: {e}")
         return None
     
+    def listen_stream(self):
+        """Читает события /api/stream, пока соединение живо. False - потока нет"""
+        try:
+            # Таймаут чтения больше периода пустых комментариев сервера (15 с)
+            with requests.get(f"{self.server_url}/api/stream", params={'sensor': self.sensor_id},
+                              stream=True, timeout=(2, 30)) as response:
+                if response.status_code != 200:
+                    return False
+                for line in response.iter_lines(decode_unicode=True):
+                    if line and line.startswith('data:'):
+                        self.add_reading(json.loads(line[5:]).get('temperature', 0.0))
+        except Exception as e:
+            print(f"Error reading stream: {e}")
+            return False
+        return True
+    
     def update_history(self):
         temp = self.fetch_current_temperature()
         if temp is not None:
-            with self.lock:
-                timestamp = datetime.now().strftime("%H:%M:%S")
-                self.history.append({
-                    'timestamp': timestamp,
-                    'temperature': temp
-                })
-                if len(self.history) > self.max_history:
-                    self.history.pop(0)
-                self.current_temp = temp
+            self.add_reading(temp)
+    
+    def add_reading(self, temp):
+        with self.lock:
+            timestamp = datetime.now().strftime("%H:%M:%S")
+            self.history.append({
+                'timestamp': timestamp,
+                'temperature': temp
+            })
+            if len(self.history) > self.max_history:
+                self.history.pop(0)
+            self.current_temp = temp
 
 client = TemperatureClient(SERVER_URL)
 
 
 def background_updater():
     while True:
-        client.update_history()
+        # Пока жив поток /api/stream, замеры приходят сами, без него - опрос
+        if not client.listen_stream():
+            client.update_history()
         time.sleep(UPDATE_INTERVAL)
 
 
@@ -0,0 +1,193 @@
+#ifndef AGGREGATOR_HPP
+#define AGGREGATOR_HPP
+
+#include "time_utils.hpp"
+
+#include <cstdint>
+#include <cmath>
+
+// Итоги интервала в виде, который складывается из частей: count/sum/
+// min/max/сумма квадратов. Из них собирается статистика по сводкам
+struct RollupTotals {
+    int64_t count;
+    double sum;
+    double min;
+    double max;
+    double sumsq;
+
+    RollupTotals() : count(0), sum(0.0), min(0.0), max(0.0), sumsq(0.0) {}
+
+    void add(double value) {
+        if (count == 0 || value < min) min = value;
+        if (count == 0 || value > max) max = value;
+
+        ++count;
+        sum += value;
+        sumsq += value * value;
+    }
+
+    void merge(const RollupTotals& other) {
+        if (other.count == 0) return;
+
+        if (count == 0 || other.min < min) min = other.min;
+        if (count == 0 || other.max > max) max = other.max;
+
+        count += other.count;
+        sum += other.sum;
+        sumsq += other.sumsq;
+    }
+
+    bool empty() const { return count == 0; }
+    double average() const { return count > 0 ? sum / count : 0.0; }
+
+    // Сумма квадратов теряет точность на больших count, отрицательное обрезаем
+    double variance() const {
+        if (count < 2) return 0.0;
+        double value = (sumsq - sum * sum / count) / (count - 1);
+        return value > 0.0 ? value : 0.0;
+    }
+
+    double stddev() const { return std::sqrt(variance()); }
+};
+
+// Накопитель статистики за интервал: count/sum/min/max и дисперсия
+// по Уэлфорду. Обновление и закрытие - O(1), память не зависит от частоты
+struct Accumulator {
+    int64_t count;
+    double sum;
+    double min;
+    double max;
+    double mean;
+    double m2;
+
+    Accumulator() { reset(); }
+
+    void reset() {
+        count = 0;
+        sum = 0.0;
+        min = 0.0;
+        max = 0.0;
+        mean = 0.0;
+        m2 = 0.0;
+    }
+
+    void add(double value) {
+        if (count == 0 || value < min) min = value;
+        if (count == 0 || value > max) max = value;
+
+        ++count;
+        sum += value;
+
+        double delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+    }
+
+    // Добавляет целую сводку (параллельная формула Чана для дисперсии)
+    void merge(const RollupTotals& totals) {
+        if (totals.empty()) return;
+
+        if (count == 0 || totals.min < min) min = totals.min;
+        if (count == 0 || totals.max > max) max = totals.max;
+
+        double other_mean = totals.average();
+        double other_m2 = totals.variance() * (totals.count - 1);
+        int64_t total = count + totals.count;
+        double delta = other_mean - mean;
+
+        m2 += other_m2 + delta * delta * count * totals.count / total;
+        mean += delta * totals.count / total;
+        sum += totals.sum;
+        count = total;
+    }
+
+    bool empty() const { return count == 0; }
+    double average() const { return count > 0 ? sum / count : 0.0; }
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+    double stddev() const { return std::sqrt(variance()); }
+};
+
+// Текущий интервал (локальный час или сутки) с накопителем
+class BucketAggregator {
+public:
+    enum Period {
+        PERIOD_HOUR,
+        PERIOD_DAY
+    };
+
+    struct Bucket {
+        int64_t start_ms;
+        int64_t end_ms;
+        Accumulator acc;
+
+        Bucket() : start_ms(0), end_ms(0) {}
+    };
+
+    explicit BucketAggregator(Period period) : period(period) {}
+
+    // Добавляет замер. Если он открывает новый интервал, предыдущий
+    // возвращается в closed и функция отдает true. Опоздавшие замеры
+    // (старше открытого интервала) в статистику не попадают
+    bool add(int64_t ts_ms, double value, Bucket& closed) {
+        bool has_closed = false;
+        if (!advance(ts_ms, closed, has_closed)) return false;
+
+        current.acc.add(value);
+        return has_closed;
+    }
+
+    // То же для сводки, начинающейся в ts_ms (восстановление после
+    // перезапуска). Сводка не должна пересекать границу интервала
+    bool add(int64_t ts_ms, const RollupTotals& totals, Bucket& closed) {
+        bool has_closed = false;
+        if (totals.empty() || !advance(ts_ms, closed, has_closed)) return false;
+
+        current.acc.merge(totals);
+        return has_closed;
+    }
+
+    // Закрывает интервал, если его время вышло, даже без новых замеров
+    bool closeExpired(int64_t now_ms, Bucket& closed) {
+        if (current.acc.empty() || now_ms < current.end_ms) return false;
+
+        closed = current;
+        current.acc.reset();
+        return true;
+    }
+
+    const Bucket& openBucket() const { return current; }
+
+private:
+    // Открывает интервал для ts_ms, если тот за пределами текущего.
+    // false - ts_ms старше открытого интервала
+    bool advance(int64_t ts_ms, Bucket& closed, bool& has_closed) {
+        if (!current.acc.empty() && ts_ms < current.start_ms) {
+            return false;
+        }
+
+        if (current.acc.empty() || ts_ms >= current.end_ms) {
+            if (!current.acc.empty()) {
+                closed = current;
+                has_closed = true;
+            }
+            open(ts_ms);
+        }
+        return true;
+    }
+
+    void open(int64_t ts_ms) {
+        current.acc.reset();
+        if (period == PERIOD_HOUR) {
+            current.start_ms = localHourFloorMs(ts_ms);
+            current.end_ms = current.start_ms + MS_PER_HOUR;
+        } else {
+            current.start_ms = localDayFloorMs(ts_ms);
+            current.end_ms = localDayFloorMs(current.start_ms + MS_PER_DAY + MS_PER_DAY / 2);
+        }
+    }
+
+    Period period;
+    Bucket current;
+};
+
+#endif
@@ -0,0 +1,1896 @@
+// Микробенчмарки серверной части lab6
+// Сборка: ./build_benchmark.sh
+// Запуск: ./benchmark db [число вставок]
+//         ./benchmark range [дней данных 1 Гц]
+//         ./benchmark framer [МБ] [размер порции чтения]
+//         ./benchmark parser [число строк для фаззинга]
+//         ./benchmark http [соединений] [секунд] [клиентов статистики]
+//         ./benchmark cache [соединений] [секунд]
+//         ./benchmark stream [подписчиков] [замеров в секунду] [секунд]
+//         ./benchmark export [дней данных 1 Гц]
+//         ./benchmark columnar [число замеров]
+//         ./benchmark series [дней данных 1 Гц] [точек]
+//         ./benchmark recover [дней данных 1 Гц]
+//         ./benchmark retention [дней данных 1 Гц, хранится 30]
+//         ./benchmark readers [потоков чтения] [секунд]
+//         ./benchmark writer [замеров в секунду] [секунд]
+//         ./benchmark reactor [устройств] [строк в секунду на устройство] [секунд]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "database.hpp"
+#include "line_framer.hpp"
+#include "sample_parser.hpp"
+#include "httpserver.hpp"
+#include "downsample.hpp"
+#include "retention.hpp"
+#include "sample_writer.hpp"
+#include "serial_reactor.hpp"
+
+using namespace std;
+
+// Глушим вывод базы ("Data inserted" на каждую запись) на время замеров
+class SilentCout {
+public:
+    SilentCout() : old_buf(cout.rdbuf(nullptr)) {}
+    ~SilentCout() { cout.rdbuf(old_buf); }
+
+private:
+    streambuf* old_buf;
+};
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+string temp_db_path(const string& tag) {
+    return "/tmp/oslabs_bench_" + tag + "_" + to_string(getpid()) + ".db";
+}
+
+void remove_db(const string& path) {
+    remove(path.c_str());
+    remove((path + "-wal").c_str());
+    remove((path + "-shm").c_str());
+}
+
+Database::TemperatureRecord make_record(int i) {
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "2024-01-01 %02d:%02d:%02d.%03d",
+             (i / 3600) % 24, (i / 60) % 60, i % 60, i % 1000);
+    string ts = timestamp;
+    return Database::TemperatureRecord(ts, 20.0 + (i % 100) / 10.0,
+                                       ts.substr(0, 10), ts.substr(0, 13) + ":00:00.000");
+}
+
+// Сколько памяти занимает запись вместе со строками в куче
+size_t record_footprint(const Database::TemperatureRecord& record) {
+    const string empty;
+    size_t bytes = sizeof(record);
+    for (const string* str : { &record.timestamp, &record.date, &record.hour }) {
+        if (str->capacity() > empty.capacity()) bytes += str->capacity() + 1;
+    }
+    return bytes;
+}
+
+// ---------------------------------------------------------------------------
+// db: вставки в temperature_raw до и после кэширования запросов и пачками
+// ---------------------------------------------------------------------------
+
+// Вставка как раньше: компиляция запроса на каждый вызов
+bool legacy_insert(sqlite3* db, const Database::TemperatureRecord& record) {
+    sqlite3_stmt* stmt;
+    const char* sql = R"(
+        INSERT INTO temperature_raw (ts, temperature)
+        VALUES (?, ?)
+    )";
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    int64_t ts = 0;
+    parseTimestampMs(record.timestamp, ts);
+    sqlite3_bind_int64(stmt, 1, ts);
+    sqlite3_bind_double(stmt, 2, record.temperature);
+
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+int bench_db(int count) {
+    vector<Database::TemperatureRecord> records;
+    records.reserve(count);
+    for (int i = 0; i < count; ++i) records.push_back(make_record(i));
+
+    // До: prepare/finalize на каждую вставку
+    string legacy_path = temp_db_path("legacy");
+    double legacy_sec = 0;
+    {
+        SilentCout silent;
+        Database schema;
+        if (!schema.open(legacy_path)) return 1;
+        schema.close();
+
+        sqlite3* db = nullptr;
+        sqlite3_open(legacy_path.c_str(), &db);
+        sqlite3_exec(db, "PRAGMA journal_mode = WAL", nullptr, nullptr, nullptr);
+        sqlite3_exec(db, "PRAGMA synchronous = NORMAL", nullptr, nullptr, nullptr);
+
+        auto start = chrono::steady_clock::now();
+        for (const auto& record : records) legacy_insert(db, record);
+        legacy_sec = seconds_since(start);
+
+        sqlite3_close(db);
+    }
+    remove_db(legacy_path);
+
+    // После: закэшированный запрос Database
+    string cached_path = temp_db_path("cached");
+    double cached_sec = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(cached_path)) return 1;
+
+        auto start = chrono::steady_clock::now();
+        for (const auto& record : records) db.insertRawData(record);
+        cached_sec = seconds_since(start);
+    }
+    remove_db(cached_path);
+
+    // Групповая запись: пачки по 256 записей в одной транзакции
+    string batch_path = temp_db_path("batch");
+    double batch_sec = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(batch_path)) return 1;
+
+        const size_t batch_size = 256;
+        vector<Database::TemperatureRecord> batch;
+        auto start = chrono::steady_clock::now();
+        for (const auto& record : records) {
+            batch.push_back(record);
+            if (batch.size() == batch_size) {
+                db.insertRawBatch(batch);
+                batch.clear();
+            }
+        }
+        db.insertRawBatch(batch);
+        batch_sec = seconds_since(start);
+    }
+    remove_db(batch_path);
+
+    // То же пачками компактных замеров
+    vector<Sample> samples;
+    samples.reserve(count);
+    for (const auto& record : records) {
+        Sample sample;
+        parseTimestampMs(record.timestamp, sample.ts_ms);
+        sample.value = static_cast<float>(record.temperature);
+        sample.sensor_id = 0;
+        samples.push_back(sample);
+    }
+
+    string samples_path = temp_db_path("samples");
+    double samples_sec = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(samples_path)) return 1;
+
+        const size_t batch_size = 256;
+        vector<Sample> batch;
+        batch.reserve(batch_size);
+        auto start = chrono::steady_clock::now();
+        for (const auto& sample : samples) {
+            batch.push_back(sample);
+            if (batch.size() == batch_size) {
+                db.insertSamples(batch);
+                batch.clear();
+            }
+        }
+        db.insertSamples(batch);
+        samples_sec = seconds_since(start);
+    }
+    remove_db(samples_path);
+
+    size_t record_bytes = 0;
+    for (const auto& record : records) record_bytes += record_footprint(record);
+
+    cout << fixed << setprecision(0);
+    cout << "inserts:          " << count << "\n";
+    cout << "prepare per call: " << count / legacy_sec << " inserts/s\n";
+    cout << "cached statement: " << count / cached_sec << " inserts/s\n";
+    cout << "batch of 256:     " << count / batch_sec << " inserts/s\n";
+    cout << "samples, 256:     " << count / samples_sec << " inserts/s\n";
+    cout << "memory per item:  " << record_bytes / count << " bytes (record), "
+         << sizeof(Sample) << " bytes (sample)\n";
+    cout << setprecision(2) << "speedup:          " << legacy_sec / cached_sec << "x\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// range: выборки по диапазону на месяце данных с частотой 1 Гц
+// ---------------------------------------------------------------------------
+
+template <typename F>
+double time_query(F query, int repeat = 20) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeat; ++i) query();
+    return seconds_since(start) * 1000.0 / repeat;
+}
+
+// Статистика полным проходом по temperature_raw, как до сводок
+Database::Statistics scan_statistics(sqlite3* conn, int64_t start_ms, int64_t end_ms) {
+    Database::Statistics stats;
+    sqlite3_stmt* stmt;
+    sqlite3_prepare_v2(conn, "SELECT AVG(temperature), MIN(temperature), MAX(temperature), COUNT(*) "
+                             "FROM temperature_raw WHERE ts BETWEEN ? AND ?", -1, &stmt, nullptr);
+    sqlite3_bind_int64(stmt, 1, start_ms);
+    sqlite3_bind_int64(stmt, 2, end_ms);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        stats.avg_temp = sqlite3_column_double(stmt, 0);
+        stats.min_temp = sqlite3_column_double(stmt, 1);
+        stats.max_temp = sqlite3_column_double(stmt, 2);
+        stats.sample_count = sqlite3_column_int(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+    return stats;
+}
+
+int bench_range(int days) {
+    string path = temp_db_path("range");
+    const int64_t first_ms = 1704067200000LL; // 2024-01-01 00:00:00 UTC
+    const int64_t total = days * 86400LL;
+    const int64_t last_ms = first_ms + (total - 1) * MS_PER_SECOND;
+
+    double fill_sec, current_ms, raw_hour_ms, stats_hour_ms, stats_day_ms, stats_all_ms, scan_all_ms;
+    bool stats_match = true;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        batch.reserve(4096);
+        auto fill_start = chrono::steady_clock::now();
+        for (int64_t i = 0; i < total; ++i) {
+            Sample sample;
+            sample.ts_ms = first_ms + i * MS_PER_SECOND;
+            sample.value = 20.0f + (i % 100) / 10.0f;
+            sample.sensor_id = 0;
+            batch.push_back(sample);
+            if (batch.size() == batch.capacity()) {
+                db.insertSamples(batch);
+                batch.clear();
+            }
+        }
+        db.insertSamples(batch);
+        fill_sec = seconds_since(fill_start);
+
+        current_ms = time_query([&] { db.getCurrentTemperature(); });
+        raw_hour_ms = time_query([&] { db.getRawData(last_ms - MS_PER_HOUR, last_ms, 1000); });
+        stats_hour_ms = time_query([&] { db.getStatistics(last_ms - MS_PER_HOUR, last_ms); });
+        stats_day_ms = time_query([&] { db.getStatistics(last_ms - MS_PER_DAY, last_ms); });
+        stats_all_ms = time_query([&] { db.getStatistics(first_ms, last_ms); }, 3);
+
+        // Сводки против полного прохода, в том числе на невыровненных границах
+        sqlite3* conn = nullptr;
+        sqlite3_open(path.c_str(), &conn);
+        scan_all_ms = time_query([&] { scan_statistics(conn, first_ms, last_ms); }, 3);
+
+        const int64_t ranges[][2] = {
+            { first_ms, last_ms },
+            { first_ms + 1234567, last_ms - 7654321 },
+            { last_ms - MS_PER_HOUR - 59999, last_ms - 1 },
+            { first_ms + 61000, first_ms + 119999 },
+        };
+        for (const auto& range : ranges) {
+            Database::Statistics planned = db.getStatistics(range[0], range[1]);
+            Database::Statistics scanned = scan_statistics(conn, range[0], range[1]);
+            if (planned.sample_count != scanned.sample_count ||
+                planned.min_temp != scanned.min_temp || planned.max_temp != scanned.max_temp ||
+                fabs(planned.avg_temp - scanned.avg_temp) > 1e-6) {
+                stats_match = false;
+            }
+        }
+        sqlite3_close(conn);
+    }
+    remove_db(path);
+
+    cout << fixed << setprecision(3);
+    cout << "rows:                 " << total << " (filled in " << fill_sec << " s)\n";
+    cout << "current temperature:  " << current_ms << " ms\n";
+    cout << "raw, last hour:       " << raw_hour_ms << " ms\n";
+    cout << "statistics, 1 hour:   " << stats_hour_ms << " ms\n";
+    cout << "statistics, 1 day:    " << stats_day_ms << " ms\n";
+    cout << "statistics, all:      " << stats_all_ms << " ms (full scan " << scan_all_ms << " ms)\n";
+    cout << "rollups vs scan:      " << (stats_match ? "match" : "MISMATCH") << "\n";
+    return stats_match ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// framer: нарезка входного потока на строки, старый способ против LineFramer
+// ---------------------------------------------------------------------------
+
+// Как раньше в логгере: buffer += read_buf, substr/erase и посимвольный trim
+size_t legacy_frame(const string& input, size_t chunk) {
+    string buffer;
+    vector<char> read_buf(chunk + 1);
+    size_t lines = 0;
+
+    for (size_t offset = 0; offset < input.size(); offset += chunk) {
+        size_t n = min(chunk, input.size() - offset);
+        memcpy(read_buf.data(), input.data() + offset, n);
+        read_buf[n] = '\0';
+        buffer += read_buf.data();
+
+        size_t pos = 0;
+        while ((pos = buffer.find('\n')) != string::npos) {
+            string line = buffer.substr(0, pos);
+            buffer.erase(0, pos + 1);
+
+            while (!line.empty() && (line[0] == '\r' || line[0] == '\n' || line[0] == ' ' || line[0] == '\t')) {
+                line.erase(0, 1);
+            }
+
+            if (line.empty()) continue;
+            ++lines;
+        }
+    }
+    return lines;
+}
+
+size_t framer_frame(const string& input, size_t chunk) {
+    LineFramer framer;
+    size_t lines = 0;
+
+    for (size_t offset = 0; offset < input.size();) {
+        size_t n = min(min(chunk, framer.writable()), input.size() - offset);
+        memcpy(framer.writePtr(), input.data() + offset, n);
+        framer.commit(n);
+        offset += n;
+
+        string_view line;
+        while (framer.next(line)) ++lines;
+    }
+    return lines;
+}
+
+int bench_framer(int megabytes, size_t chunk) {
+    // Пачка строк в формате эмулятора, как если бы порт долго не вычитывали
+    string input;
+    input.reserve(static_cast<size_t>(megabytes) << 20);
+    char line[128];
+    for (int i = 0; input.size() < (static_cast<size_t>(megabytes) << 20); ++i) {
+        double temp = 20.0 + (i % 100) / 10.0;
+        int len = snprintf(line, sizeof(line),
+                           "{\"timestamp\":\"2024-01-01 %02d:%02d:%02d.%03d\",\"temperature\":%.2f,\"checksum\":%.2f}\r\n",
+                           (i / 3600) % 24, (i / 60) % 60, i % 60, i % 1000, temp, temp);
+        input.append(line, len);
+    }
+
+    auto start = chrono::steady_clock::now();
+    size_t legacy_lines = legacy_frame(input, chunk);
+    double legacy_sec = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    size_t framer_lines = framer_frame(input, chunk);
+    double framer_sec = seconds_since(start);
+
+    if (legacy_lines != framer_lines) {
+        cerr << "Line count mismatch: " << legacy_lines << " vs " << framer_lines << "\n";
+        return 1;
+    }
+
+    double mb = input.size() / 1048576.0;
+    cout << fixed << setprecision(1);
+    cout << "input:        " << mb << " MB, " << framer_lines << " lines, chunk " << chunk << " bytes\n";
+    cout << "string+erase: " << mb / legacy_sec << " MB/s, " << setprecision(0) << legacy_lines / legacy_sec << " lines/s\n";
+    cout << setprecision(1);
+    cout << "LineFramer:   " << mb / framer_sec << " MB/s, " << setprecision(0) << framer_lines / framer_sec << " lines/s\n";
+    cout << setprecision(2) << "speedup:      " << legacy_sec / framer_sec << "x\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// parser: parseSample против прежнего parse_json (find/substr/stod)
+// ---------------------------------------------------------------------------
+
+// Прежний TemperatureLogger::parse_json без вывода ошибок. Он сдвигался
+// на фиксированное число символов после ключа и рассчитывал на пробел после
+// "timestamp": и "chk": и на его отсутствие после "time":, иначе терял
+// первый символ значения. С fixed_offsets сдвиги исправлены - это эталон,
+// с которым должен совпадать parseSample
+bool legacy_parse_json(const string& json_str, Database::TemperatureRecord& record, bool fixed_offsets = false) {
+    size_t temp_pos = json_str.find("\"temperature\":");
+    size_t checksum_pos = json_str.find("\"checksum\":");
+    size_t time_pos = json_str.find("\"timestamp\":");
+
+    if (temp_pos == string::npos || checksum_pos == string::npos || time_pos == string::npos) {
+        temp_pos = json_str.find("\"temp\":");
+        checksum_pos = json_str.find("\"chk\":");
+        time_pos = json_str.find("\"time\":");
+
+        if (temp_pos == string::npos || checksum_pos == string::npos || time_pos == string::npos) {
+            return false;
+        }
+
+        temp_pos += 7;
+        checksum_pos += fixed_offsets ? 6 : 7;
+        time_pos += 7;
+    } else {
+        temp_pos += 14;
+        checksum_pos += 11;
+        time_pos += fixed_offsets ? 12 : 13;
+    }
+
+    if (fixed_offsets) {
+        time_pos = json_str.find_first_not_of(" \t\n\v\f\r", time_pos);
+        if (time_pos == string::npos) return false;
+    }
+
+    size_t temp_end = json_str.find_first_of(",}", temp_pos);
+    if (temp_end == string::npos) return false;
+
+    string temp_str = json_str.substr(temp_pos, temp_end - temp_pos);
+    double temperature;
+    try {
+        temperature = stod(temp_str);
+    } catch (...) {
+        return false;
+    }
+
+    size_t checksum_end = json_str.find_first_of(",}", checksum_pos);
+    if (checksum_end == string::npos) return false;
+
+    string checksum_str = json_str.substr(checksum_pos, checksum_end - checksum_pos);
+    double checksum;
+    try {
+        checksum = stod(checksum_str);
+    } catch (...) {
+        return false;
+    }
+
+    const double EPSILON = 0.01;
+    if (fabs(temperature - checksum) > EPSILON) return false;
+
+    size_t time_end = json_str.find('"', time_pos + 1);
+    if (time_end == string::npos) {
+        time_end = json_str.find_first_of(",}", time_pos);
+        if (time_end == string::npos) return false;
+        record.timestamp = json_str.substr(time_pos, time_end - time_pos);
+    } else {
+        record.timestamp = json_str.substr(time_pos + 1, time_end - time_pos - 1);
+    }
+
+    record.temperature = temperature;
+    record.date = record.timestamp.length() >= 10 ? record.timestamp.substr(0, 10) : "";
+    record.hour = record.timestamp.length() >= 13 ? record.timestamp.substr(0, 13) + ":00:00.000" : "";
+    return true;
+}
+
+// Строка в одном из форматов, которые встречаются на входе
+string make_line(mt19937& rng, int i) {
+    uniform_int_distribution<int> pick(0, 3);
+    double temp = (static_cast<int>(rng() % 8001) - 4000) / 100.0;
+    char timestamp[32];
+    snprintf(timestamp, sizeof(timestamp), "2024-%02d-%02d %02d:%02d:%02d.%03d",
+             1 + i % 12, 1 + i % 28, i % 24, i % 60, (i / 60) % 60, i % 1000);
+
+    char line[160];
+    switch (pick(rng)) {
+    case 0: // как пишет эмулятор
+        snprintf(line, sizeof(line), "{\"temperature\": %.2f, \"timestamp\": \"%s\", \"checksum\": %.2f}",
+                 temp, timestamp, temp);
+        break;
+    case 1: // без пробелов
+        snprintf(line, sizeof(line), "{\"timestamp\":\"%s\",\"temperature\":%.2f,\"checksum\":%.2f}",
+                 timestamp, temp, temp);
+        break;
+    case 2: // короткие ключи
+        snprintf(line, sizeof(line), "{\"time\":\"%s\",\"temp\":%.3f,\"chk\":%.3f}",
+                 timestamp, temp, temp + (rng() % 3) / 100.0);
+        break;
+    default: // неверная контрольная сумма
+        snprintf(line, sizeof(line), "{\"temperature\":%.2f,\"checksum\":%.2f,\"timestamp\":\"%s\"}",
+                 temp, temp + 1.0, timestamp);
+        break;
+    }
+    return line;
+}
+
+// Портим строку: замена, вставка, удаление символа или обрезка
+void mutate(mt19937& rng, string& line) {
+    static const char alphabet[] = "0123456789.-+e,:{}\" tcmp";
+    int ops = rng() % 4;
+    for (int op = 0; op < ops && !line.empty(); ++op) {
+        size_t pos = rng() % line.size();
+        char c = alphabet[rng() % (sizeof(alphabet) - 1)];
+        switch (rng() % 4) {
+        case 0: line[pos] = c; break;
+        case 1: line.insert(line.begin() + pos, c); break;
+        case 2: line.erase(pos, 1); break;
+        default: line.resize(pos); break;
+        }
+    }
+}
+
+int bench_parser(int count) {
+    const int64_t NOW = -1;
+    mt19937 rng(12345);
+
+    // Фаззинг: оба разборщика должны давать одно и то же
+    int accepted = 0, rejected = 0, legacy_differs = 0, mismatches = 0;
+    for (int i = 0; i < count; ++i) {
+        string line = make_line(rng, i);
+        mutate(rng, line);
+
+        Sample sample;
+        bool fast_ok = parseSample(line, NOW, sample) == PARSE_OK;
+
+        Database::TemperatureRecord original;
+        bool original_ok = legacy_parse_json(line, original);
+        int64_t original_ts = NOW;
+        if (original_ok && !parseTimestampMs(original.timestamp, original_ts)) original_ts = NOW;
+
+        Database::TemperatureRecord record;
+        bool legacy_ok = legacy_parse_json(line, record, true);
+        int64_t legacy_ts = NOW;
+        if (legacy_ok && !parseTimestampMs(record.timestamp, legacy_ts)) legacy_ts = NOW;
+
+        bool same = legacy_ok == fast_ok;
+        if (same && fast_ok) {
+            same = legacy_ts == sample.ts_ms &&
+                   (static_cast<float>(record.temperature) == sample.value ||
+                    (std::isnan(record.temperature) && std::isnan(sample.value)));
+        }
+
+        if (original_ok != fast_ok || (fast_ok && original_ts != sample.ts_ms)) {
+            ++legacy_differs;
+        }
+
+        if (!same) {
+            if (++mismatches <= 10) {
+                cerr << "Mismatch: " << line << "\n";
+            }
+        } else if (fast_ok) {
+            ++accepted;
+        } else {
+            ++rejected;
+        }
+    }
+
+    // Скорость на строках эмулятора
+    const int lines_count = 1000000;
+    vector<string> lines;
+    lines.reserve(1000);
+    for (int i = 0; i < 1000; ++i) {
+        char line[160];
+        double temp = 20.0 + (i % 100) / 10.0;
+        snprintf(line, sizeof(line),
+                 "{\"temperature\": %.2f, \"timestamp\": \"2024-01-01 12:%02d:%02d.%03d\", \"checksum\": %.2f}",
+                 temp, i / 60 % 60, i % 60, i, temp);
+        lines.push_back(line);
+    }
+
+    double sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < lines_count; ++i) {
+        Database::TemperatureRecord record;
+        if (legacy_parse_json(lines[i % lines.size()], record)) sink += record.temperature;
+    }
+    double legacy_sec = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < lines_count; ++i) {
+        Sample sample;
+        if (parseSample(lines[i % lines.size()], 0, sample) == PARSE_OK) sink += sample.value;
+    }
+    double fast_sec = seconds_since(start);
+
+    cout << "fuzz lines:    " << count << " (accepted " << accepted << ", rejected " << rejected
+         << ", mismatches " << mismatches << ")\n";
+    cout << "differs from unfixed parse_json: " << legacy_differs << "\n";
+    cout << fixed << setprecision(0);
+    cout << "parse_json:    " << lines_count / legacy_sec << " lines/s\n";
+    cout << "parseSample:   " << lines_count / fast_sec << " lines/s\n";
+    cout << setprecision(2) << "speedup:       " << legacy_sec / fast_sec << "x";
+    cout << (sink == 0 ? " \n" : "\n");
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// http: запросы в секунду к /api/current от нескольких клиентов
+// ---------------------------------------------------------------------------
+
+const int BENCH_HTTP_PORT = 18080;
+
+int connect_local(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return sock;
+}
+
+// Отправляет запрос и дочитывает ответ по Content-Length
+bool http_get(int sock, const string& request, string& buffer) {
+    if (send(sock, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        return false;
+    }
+
+    buffer.clear();
+    char chunk[4096];
+    for (;;) {
+        size_t header_end = buffer.find("\r\n\r\n");
+        if (header_end != string::npos) {
+            size_t length_pos = buffer.find("Content-Length: ");
+            if (length_pos == string::npos || length_pos > header_end) return false;
+            size_t length = strtoul(buffer.c_str() + length_pos + 16, nullptr, 10);
+            if (buffer.size() >= header_end + 4 + length) return true;
+        }
+
+        ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) return false;
+        buffer.append(chunk, received);
+    }
+}
+
+// Нагрузка одного вида: clients потоков шлют path, пока не поднят stop
+struct HttpLoad {
+    atomic<long> done;
+    atomic<long> failed;
+    mutex latency_mutex;
+    vector<double> latencies_ms;
+
+    HttpLoad() : done(0), failed(0) {}
+};
+
+void start_http_clients(vector<thread>& threads, int clients, const string& path, bool keep_alive,
+                        const atomic<bool>& stop, HttpLoad& load) {
+    const string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n" +
+                           (keep_alive ? "" : "Connection: close\r\n") + "\r\n";
+
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back([&load, &stop, request, keep_alive]() {
+            string buffer;
+            vector<double> latencies;
+            int sock = -1;
+            while (!stop) {
+                auto start = chrono::steady_clock::now();
+                if (sock < 0) sock = connect_local(BENCH_HTTP_PORT);
+                if (sock < 0 || !http_get(sock, request, buffer)) {
+                    ++load.failed;
+                    buffer.clear();
+                } else {
+                    ++load.done;
+                    latencies.push_back(seconds_since(start) * 1000.0);
+                }
+                if (!keep_alive || buffer.empty()) {
+                    if (sock >= 0) close(sock);
+                    sock = -1;
+                }
+            }
+            if (sock >= 0) close(sock);
+
+            lock_guard<mutex> lock(load.latency_mutex);
+            load.latencies_ms.insert(load.latencies_ms.end(), latencies.begin(), latencies.end());
+        });
+    }
+}
+
+double percentile(vector<double>& values, double p) {
+    if (values.empty()) return 0.0;
+    sort(values.begin(), values.end());
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+}
+
+void print_load(const string& name, HttpLoad& load, double elapsed) {
+    cout << name << load.done / elapsed << " requests/s, p50 " << setprecision(2)
+         << percentile(load.latencies_ms, 0.5) << " ms, p99 " << percentile(load.latencies_ms, 0.99)
+         << " ms (" << load.failed << " failed)\n" << setprecision(0);
+}
+
+int bench_http(int clients, double seconds, int slow_clients) {
+    string path = temp_db_path("http");
+    SampleRings rings;
+    SampleRing& ring = rings.add(0);
+    Sample sample = { currentTimeMs(), 21.5f, 0 };
+    ring.push(sample);
+
+    // Сутки данных 1 Гц, чтобы статистика за все время была заметно тяжелой
+    const int64_t first_ms = 1704067200000LL;
+    const string statistics_path = "/api/statistics?start=2023-12-01&end=2024-02-01";
+
+    HttpLoad keep_alive, one_shot, fast, slow;
+    double keep_alive_sec, one_shot_sec, mixed_sec;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        for (int64_t i = 0; i < 86400; ++i) {
+            Sample row = { first_ms + i * MS_PER_SECOND, 20.0f + (i % 100) / 10.0f, 0 };
+            batch.push_back(row);
+        }
+        db.insertSamples(batch);
+
+        HTTPServer server(&db, &rings, "127.0.0.1", BENCH_HTTP_PORT);
+        if (!server.start()) return 1;
+
+        auto run = [&](function<void(vector<thread>&, atomic<bool>&)> spawn) {
+            atomic<bool> stop(false);
+            vector<thread> threads;
+            spawn(threads, stop);
+            auto start = chrono::steady_clock::now();
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            stop = true;
+            for (auto& t : threads) t.join();
+            return seconds_since(start);
+        };
+
+        keep_alive_sec = run([&](vector<thread>& threads, atomic<bool>& stop) {
+            start_http_clients(threads, clients, "/api/current", true, stop, keep_alive);
+        });
+        one_shot_sec = run([&](vector<thread>& threads, atomic<bool>& stop) {
+            start_http_clients(threads, clients, "/api/current", false, stop, one_shot);
+        });
+        // Быстрые запросы на фоне тяжелой статистики
+        mixed_sec = run([&](vector<thread>& threads, atomic<bool>& stop) {
+            start_http_clients(threads, clients, "/api/current", true, stop, fast);
+            start_http_clients(threads, slow_clients, statistics_path, true, stop, slow);
+        });
+
+        server.stop();
+    }
+    remove_db(path);
+
+    cout << fixed << setprecision(0);
+    cout << "clients:               " << clients << " (+" << slow_clients << " statistics clients in mixed run)\n";
+    print_load("keep-alive:            ", keep_alive, keep_alive_sec);
+    print_load("connection: close:     ", one_shot, one_shot_sec);
+    print_load("mixed, current:        ", fast, mixed_sec);
+    print_load("mixed, statistics:     ", slow, mixed_sec);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// cache: /api/hourly за месяц - первый запрос и повторные из кэша ответов
+// ---------------------------------------------------------------------------
+
+int bench_cache(int clients, double seconds) {
+    string path = temp_db_path("cache");
+    const string request_path = "/api/hourly?start=2024-01-01&end=2024-01-31";
+    const string request = "GET " + request_path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    double query_ms, cold_ms, warm_sec;
+    size_t body_size = 0;
+    HttpLoad warm;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        const int64_t first_ms = 1704067200000LL;
+        for (int h = 0; h < 31 * 24; ++h) {
+            db.insertHourlyAverage(formatHourMs(first_ms + h * MS_PER_HOUR), 20.0 + h % 10, 19.0, 25.0, 3600);
+        }
+
+        // Цена без кэша: запрос к базе (JSON поверх него еще дороже)
+        query_ms = time_query([&] { db.getHourlyAverages("2024-01-01", "2024-01-31"); });
+
+        // Все часы января закрыты, как после восстановления логгера
+        HTTPServer server(&db, nullptr, "127.0.0.1", BENCH_HTTP_PORT);
+        server.bucketClosed(0, BucketAggregator::PERIOD_HOUR, first_ms + 31 * 24 * MS_PER_HOUR);
+        if (!server.start()) return 1;
+
+        int sock = connect_local(BENCH_HTTP_PORT);
+        string buffer;
+        auto start = chrono::steady_clock::now();
+        if (sock < 0 || !http_get(sock, request, buffer)) return 1;
+        cold_ms = seconds_since(start) * 1000.0;
+        body_size = buffer.size();
+        close(sock);
+
+        atomic<bool> stop(false);
+        vector<thread> threads;
+        start_http_clients(threads, clients, request_path, true, stop, warm);
+        start = chrono::steady_clock::now();
+        this_thread::sleep_for(chrono::duration<double>(seconds));
+        stop = true;
+        for (auto& t : threads) t.join();
+        warm_sec = seconds_since(start);
+
+        server.stop();
+    }
+    remove_db(path);
+
+    cout << fixed << setprecision(3);
+    cout << "response:              " << body_size << " bytes, 744 hourly rows\n";
+    cout << "database query:        " << query_ms << " ms\n";
+    cout << "first request:         " << cold_ms << " ms\n";
+    cout << setprecision(0);
+    print_load("cached, keep-alive:    ", warm, warm_sec);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// stream: задержка доставки замеров подписчикам /api/stream
+// ---------------------------------------------------------------------------
+
+int bench_stream(int clients, int rate, double seconds) {
+    string path = temp_db_path("stream");
+
+    atomic<bool> stop(false);
+    atomic<int> connected(0);
+    mutex latency_mutex;
+    vector<double> latencies_ms;
+    long events = 0;
+    double publish_max_us = 0.0;
+    int stalled_sock = -1;
+    bool stalled_dropped = false;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        HTTPServer server(&db, nullptr, "127.0.0.1", BENCH_HTTP_PORT);
+        if (!server.start()) return 1;
+
+        const string request = "GET /api/stream HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        vector<thread> threads;
+        for (int c = 0; c < clients; ++c) {
+            threads.emplace_back([&]() {
+                int sock = connect_local(BENCH_HTTP_PORT);
+                if (sock < 0) return;
+                send(sock, request.data(), request.size(), MSG_NOSIGNAL);
+                timeval timeout = { 0, 200000 };
+                setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                ++connected;
+
+                // Метка времени события - момент публикации, задержка с точностью до мс
+                string buffer;
+                vector<double> latencies;
+                char chunk[4096];
+                while (!stop) {
+                    ssize_t received = recv(sock, chunk, sizeof(chunk), 0);
+                    if (received == 0) break;
+                    if (received < 0) continue;
+                    int64_t now = currentTimeMs();
+                    buffer.append(chunk, received);
+
+                    size_t pos;
+                    while ((pos = buffer.find("\n\n")) != string::npos) {
+                        size_t ts = buffer.find("\"timestamp\": \"");
+                        int64_t ts_ms;
+                        if (ts < pos && parseTimestampMs(buffer.substr(ts + 14, 23), ts_ms)) {
+                            latencies.push_back(static_cast<double>(now - ts_ms));
+                        }
+                        buffer.erase(0, pos + 2);
+                    }
+                }
+                close(sock);
+
+                lock_guard<mutex> lock(latency_mutex);
+                latencies_ms.insert(latencies_ms.end(), latencies.begin(), latencies.end());
+            });
+        }
+
+        // Подписчик, который ничего не читает, должен быть отключен, а не тормозить логгер
+        stalled_sock = connect_local(BENCH_HTTP_PORT);
+        if (stalled_sock >= 0) {
+            int small = 4096;
+            setsockopt(stalled_sock, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+            send(stalled_sock, request.data(), request.size(), MSG_NOSIGNAL);
+        }
+
+        while (connected < clients) this_thread::sleep_for(chrono::milliseconds(10));
+        this_thread::sleep_for(chrono::milliseconds(100));
+
+        auto interval = chrono::duration<double>(1.0 / rate);
+        auto start = chrono::steady_clock::now();
+        auto next = start;
+        while (seconds_since(start) < seconds) {
+            Sample sample = { currentTimeMs(), 20.0f + (events % 100) / 10.0f, 0 };
+            auto publish_start = chrono::steady_clock::now();
+            server.publishSample(sample);
+            publish_max_us = max(publish_max_us, seconds_since(publish_start) * 1e6);
+            ++events;
+
+            next += chrono::duration_cast<chrono::steady_clock::duration>(interval);
+            this_thread::sleep_until(next);
+        }
+
+        this_thread::sleep_for(chrono::milliseconds(300));
+        stop = true;
+        for (auto& t : threads) t.join();
+
+        // Отключенный сервером подписчик дочитает буфер и получит конец потока,
+        // оставшийся - упрется в таймаут. Таймаут с запасом: после долгого
+        // нулевого окна ядро сервера досылает остаток с задержкой в секунды
+        if (stalled_sock >= 0) {
+            timeval timeout = { 5, 0 };
+            setsockopt(stalled_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            char chunk[65536];
+            ssize_t received;
+            while ((received = recv(stalled_sock, chunk, sizeof(chunk), 0)) > 0) {}
+            stalled_dropped = received == 0;
+            close(stalled_sock);
+        }
+        server.stop();
+    }
+    remove_db(path);
+
+    size_t expected = static_cast<size_t>(events) * clients;
+    cout << fixed << setprecision(2);
+    cout << "subscribers:           " << clients << ", " << events << " events at " << rate << "/s\n";
+    cout << "delivered:             " << latencies_ms.size() << " of " << expected << "\n";
+    cout << "latency:               p50 " << percentile(latencies_ms, 0.5) << " ms, p99 "
+         << percentile(latencies_ms, 0.99) << " ms, max " << percentile(latencies_ms, 1.0) << " ms\n";
+    cout << "publishSample max:     " << publish_max_us << " us\n";
+    cout << "stalled subscriber:    " << (stalled_dropped ? "dropped" : "still connected") << "\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// export: выгрузка всего диапазона /api/raw целиком и потоком (stream=1)
+// ---------------------------------------------------------------------------
+
+// Текущий размер резидентной памяти процесса
+size_t resident_bytes() {
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// Читает ответ, не сохраняя тело (чтобы память клиента не попала в замер):
+// по Content-Length или до завершающего chunk. Возвращает размер тела
+size_t http_discard(int sock, const string& request) {
+    if (send(sock, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        return 0;
+    }
+
+    string head;
+    vector<char> chunk(1 << 16);
+    size_t body = 0, length = 0;
+    bool chunked = false, have_head = false;
+    string tail;
+    for (;;) {
+        ssize_t received = recv(sock, chunk.data(), chunk.size(), 0);
+        if (received <= 0) return body;
+
+        size_t offset = 0;
+        if (!have_head) {
+            head.append(chunk.data(), received);
+            size_t header_end = head.find("\r\n\r\n");
+            if (header_end == string::npos) continue;
+            have_head = true;
+            chunked = head.find("Transfer-Encoding: chunked") < header_end;
+            size_t length_pos = head.find("Content-Length: ");
+            if (length_pos < header_end) length = strtoul(head.c_str() + length_pos + 16, nullptr, 10);
+            offset = received - (head.size() - header_end - 4);
+        }
+
+        body += received - offset;
+        if (!chunked && body >= length) return body;
+        if (chunked) {
+            tail.append(chunk.data() + offset, received - offset);
+            if (tail.size() > 5) tail.erase(0, tail.size() - 5);
+            if (tail == "0\r\n\r\n") return body;
+        }
+    }
+}
+
+int bench_export(int days) {
+    string path = temp_db_path("export");
+    const int64_t first_ms = 1704067200000LL;
+    const int64_t total = days * 86400LL;
+    const string range = "start=2024-01-01%2000:00:00&end=2025-01-01%2000:00:00";
+
+    struct Run { double sec; size_t bytes; size_t peak; };
+    Run whole = { 0, 0, 0 }, streamed = { 0, 0, 0 };
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        batch.reserve(4096);
+        for (int64_t i = 0; i < total; ++i) {
+            Sample sample = { first_ms + i * MS_PER_SECOND, 20.0f + (i % 100) / 10.0f, 0 };
+            batch.push_back(sample);
+            if (batch.size() == batch.capacity()) {
+                db.insertSamples(batch);
+                batch.clear();
+            }
+        }
+        db.insertSamples(batch);
+
+        HTTPServer server(&db, nullptr, "127.0.0.1", BENCH_HTTP_PORT);
+        if (!server.start()) return 1;
+
+        // Пик памяти сверх исходной, пока идет запрос
+        auto measure = [&](const string& request) {
+            Run run = { 0, 0, 0 };
+            size_t base = resident_bytes();
+            atomic<bool> done(false);
+            thread sampler([&]() {
+                while (!done) {
+                    run.peak = max(run.peak, resident_bytes());
+                    this_thread::sleep_for(chrono::milliseconds(5));
+                }
+            });
+
+            int sock = connect_local(BENCH_HTTP_PORT);
+            auto start = chrono::steady_clock::now();
+            run.bytes = sock >= 0 ? http_discard(sock, request) : 0;
+            run.sec = seconds_since(start);
+            if (sock >= 0) close(sock);
+
+            done = true;
+            sampler.join();
+            run.peak = run.peak > base ? run.peak - base : 0;
+            return run;
+        };
+
+        streamed = measure("GET /api/raw?" + range + "&stream=1 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        whole = measure("GET /api/raw?" + range + "&limit=" + to_string(total) +
+                        " HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        server.stop();
+    }
+    remove_db(path);
+
+    cout << fixed << setprecision(2);
+    cout << "rows:                  " << total << "\n";
+    cout << "whole response:        " << whole.bytes / 1e6 << " MB in " << whole.sec << " s, peak +"
+         << whole.peak / 1e6 << " MB\n";
+    cout << "stream=1 (chunked):    " << streamed.bytes / 1e6 << " MB in " << streamed.sec << " s, peak +"
+         << streamed.peak / 1e6 << " MB\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// columnar: /api/raw в JSON и в колоночном виде - передача и разбор клиентом
+// ---------------------------------------------------------------------------
+
+// Разбор JSON-ответа так, как это делает окно: метка времени строкой,
+// температура числом. Без Qt, поэтому это нижняя оценка его стоимости
+size_t parse_json_history(const string& body, vector<Sample>& samples) {
+    samples.clear();
+    size_t pos = 0;
+    while ((pos = body.find("\"timestamp\": \"", pos)) != string::npos) {
+        pos += 14;
+        size_t end = body.find('"', pos);
+        size_t value_pos = body.find("\"temperature\": ", end);
+        if (end == string::npos || value_pos == string::npos) break;
+
+        Sample sample = { 0, 0.0f, 0 };
+        if (parseTimestampMs(body.data() + pos, end - pos, sample.ts_ms)) {
+            sample.value = static_cast<float>(strtod(body.c_str() + value_pos + 15, nullptr));
+            samples.push_back(sample);
+        }
+        pos = value_pos;
+    }
+    return samples.size();
+}
+
+int bench_columnar(int count) {
+    string path = temp_db_path("columnar");
+    const int64_t first_ms = 1704067200000LL;
+    const string request = "GET /api/raw?start=2024-01-01%2000:00:00&end=2025-01-01%2000:00:00&limit=" +
+                           to_string(count) + " HTTP/1.1\r\nHost: localhost\r\n";
+    const int runs = 5;
+
+    string json_response, columnar_response;
+    double json_transfer = 0, columnar_transfer = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        for (int i = 0; i < count; ++i) {
+            Sample sample = { first_ms + i * MS_PER_SECOND, 20.0f + (i % 100) / 10.0f, 0 };
+            batch.push_back(sample);
+        }
+        db.insertSamples(batch);
+
+        HTTPServer server(&db, nullptr, "127.0.0.1", BENCH_HTTP_PORT);
+        if (!server.start()) return 1;
+
+        int sock = connect_local(BENCH_HTTP_PORT);
+        for (int run = 0; run < runs && sock >= 0; ++run) {
+            auto start = chrono::steady_clock::now();
+            if (!http_get(sock, request + "\r\n", json_response)) break;
+            json_transfer += seconds_since(start);
+
+            start = chrono::steady_clock::now();
+            if (!http_get(sock, request + "Accept: " COLUMNAR_CONTENT_TYPE "\r\n\r\n", columnar_response)) break;
+            columnar_transfer += seconds_since(start);
+        }
+        if (sock >= 0) close(sock);
+        server.stop();
+    }
+    remove_db(path);
+
+    string json_body = json_response.substr(min(json_response.find("\r\n\r\n") + 4, json_response.size()));
+    string columnar_body = columnar_response.substr(
+        min(columnar_response.find("\r\n\r\n") + 4, columnar_response.size()));
+
+    vector<Sample> from_json, from_columnar;
+    auto start = chrono::steady_clock::now();
+    for (int run = 0; run < runs; ++run) parse_json_history(json_body, from_json);
+    double json_parse = seconds_since(start);
+
+    bool decoded = true;
+    start = chrono::steady_clock::now();
+    for (int run = 0; run < runs; ++run) {
+        from_columnar.clear();
+        decoded = decodeColumnar(columnar_body.data(), columnar_body.size(), [&](int64_t ts_ms, float value) {
+            Sample sample = { ts_ms, value, 0 };
+            from_columnar.push_back(sample);
+        }) && decoded;
+    }
+    double columnar_parse = seconds_since(start);
+
+    // JSON округляет до сотых, колонки передают float как есть
+    size_t mismatches = from_json.size() == from_columnar.size() ? 0 : 1;
+    for (size_t i = 0; mismatches == 0 && i < from_json.size(); ++i) {
+        if (from_json[i].ts_ms != from_columnar[i].ts_ms ||
+            fabs(from_json[i].value - from_columnar[i].value) > 0.006) {
+            ++mismatches;
+        }
+    }
+
+    double json_total = (json_transfer + json_parse) / runs;
+    double columnar_total = (columnar_transfer + columnar_parse) / runs;
+
+    cout << fixed << setprecision(2);
+    cout << "samples:         " << from_columnar.size() << " of " << count
+         << (decoded && mismatches == 0 ? "" : " (MISMATCH)") << "\n";
+    cout << "json:            " << json_body.size() / 1e6 << " MB, transfer "
+         << json_transfer / runs * 1000 << " ms, parse " << json_parse / runs * 1000 << " ms\n";
+    cout << "columnar:        " << columnar_body.size() / 1e6 << " MB, transfer "
+         << columnar_transfer / runs * 1000 << " ms, parse " << columnar_parse / runs * 1000 << " ms\n";
+    cout << "size ratio:      " << static_cast<double>(json_body.size()) / max<size_t>(columnar_body.size(), 1)
+         << "x\n";
+    cout << "speedup:         " << json_total / max(columnar_total, 1e-9) << "x\n";
+    return decoded && mismatches == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// series: прореженный ряд /api/series для диапазонов от часа до месяца
+// ---------------------------------------------------------------------------
+
+// Метка времени для строки запроса
+string query_time(int64_t ms) {
+    string value = formatTimestampMs(ms);
+    size_t space = value.find(' ');
+    return space == string::npos ? value : value.replace(space, 1, "%20");
+}
+
+int bench_series(int days, int points) {
+    string path = temp_db_path("series");
+    const int64_t first_ms = 1704067200000LL;
+    const int64_t total = days * 86400LL;
+
+    // Значение с редкими выбросами: они обязаны пережить прореживание
+    auto value_at = [](int64_t i) {
+        if (i % 100003 == 5000) return 80.0f;
+        if (i % 100019 == 7000) return -40.0f;
+        return 20.0f + 5.0f * static_cast<float>(sin(i / 3600.0)) + (i % 7) / 10.0f;
+    };
+
+    int failures = 0;
+    ostringstream report;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        batch.reserve(4096);
+        for (int64_t i = 0; i < total; ++i) {
+            Sample sample = { first_ms + i * MS_PER_SECOND, value_at(i), 0 };
+            batch.push_back(sample);
+            if (batch.size() == batch.capacity()) {
+                db.insertSamples(batch);
+                batch.clear();
+            }
+        }
+        db.insertSamples(batch);
+
+        HTTPServer server(&db, nullptr, "127.0.0.1", BENCH_HTTP_PORT);
+        if (!server.start()) return 1;
+        int sock = connect_local(BENCH_HTTP_PORT);
+
+        const int64_t spans[] = { 3600, 86400, 7 * 86400LL, total };
+        for (int64_t span : spans) {
+            if (span > total || sock < 0) continue;
+
+            string request = "GET /api/series?start=" + query_time(first_ms) +
+                             "&end=" + query_time(first_ms + (span - 1) * MS_PER_SECOND) +
+                             "&points=" + to_string(points) + " HTTP/1.1\r\nHost: localhost\r\n" +
+                             "Accept: " COLUMNAR_CONTENT_TYPE "\r\n\r\n";
+            string response;
+            auto start = chrono::steady_clock::now();
+            bool ok = http_get(sock, request, response);
+            double sec = seconds_since(start);
+
+            vector<Sample> series;
+            size_t body = ok ? response.find("\r\n\r\n") + 4 : response.size();
+            ok = ok && decodeColumnar(response.data() + body, response.size() - body,
+                                      [&](int64_t ts_ms, float value) {
+                                          Sample sample = { ts_ms, value, 0 };
+                                          series.push_back(sample);
+                                      });
+
+            // Точек не больше points, по возрастанию, крайние значения на месте
+            float expected_min = value_at(0), expected_max = value_at(0);
+            for (int64_t i = 0; i < span; ++i) {
+                expected_min = min(expected_min, value_at(i));
+                expected_max = max(expected_max, value_at(i));
+            }
+            float got_min = series.empty() ? 0.0f : series[0].value, got_max = got_min;
+            bool ordered = true;
+            for (size_t i = 0; i < series.size(); ++i) {
+                got_min = min(got_min, series[i].value);
+                got_max = max(got_max, series[i].value);
+                if (i > 0 && series[i].ts_ms <= series[i - 1].ts_ms) ordered = false;
+            }
+            bool faithful = ok && !series.empty() && series.size() <= static_cast<size_t>(points) &&
+                            ordered && got_min == expected_min && got_max == expected_max;
+            if (!faithful) ++failures;
+
+            report << fixed << setprecision(2) << "range " << setw(8) << span << " s: " << setw(5)
+                 << series.size() << " points in " << setw(7) << sec * 1000 << " ms"
+                 << (faithful ? "" : "  (MISMATCH)") << "\n";
+        }
+
+        if (sock >= 0) close(sock);
+        server.stop();
+    }
+    remove_db(path);
+
+    cout << report.str();
+    return failures == 0 ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// recover: открытые час и сутки после перезапуска из минутных сводок
+// ---------------------------------------------------------------------------
+
+int bench_recover(int days) {
+    string path = temp_db_path("recover");
+    const int64_t total = days * 86400LL;
+    // Последний замер посреди локального часа, чтобы час и сутки были открыты
+    const int64_t last_ms = localHourFloorMs(1704067200000LL + total * MS_PER_SECOND) + 13 * MS_PER_HOUR +
+                           37 * MS_PER_MINUTE + 12345;
+    const int64_t first_ms = last_ms - (total - 1) * MS_PER_SECOND;
+
+    double recover_ms = 0;
+    size_t minutes = 0;
+    BucketAggregator hourly(BucketAggregator::PERIOD_HOUR), daily(BucketAggregator::PERIOD_DAY);
+    Accumulator open_hour, open_day;
+    int closed_hours = 0, closed_days = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        batch.reserve(4096);
+        for (int64_t i = 0; i < total; ++i) {
+            Sample sample = { first_ms + i * MS_PER_SECOND, 20.0f + (i % 100) / 10.0f + (i % 7) * 0.01f, 0 };
+            batch.push_back(sample);
+            if (batch.size() == batch.capacity()) {
+                db.insertSamples(batch);
+                batch.clear();
+            }
+        }
+        db.insertSamples(batch);
+
+        // Как TemperatureLogger::recoverBuckets
+        auto start = chrono::steady_clock::now();
+        int64_t last_minute = 0;
+        if (db.getLastRollupMinute(last_minute)) {
+            int64_t from_ms = localDayFloorMs(localDayFloorMs(last_minute) - 1);
+            vector<Database::RollupBucket> rollups = db.getMinuteRollups(from_ms, last_minute + MS_PER_MINUTE);
+            BucketAggregator::Bucket closed;
+            for (const auto& minute : rollups) {
+                if (hourly.add(minute.start_ms, minute.totals, closed)) ++closed_hours;
+                if (daily.add(minute.start_ms, minute.totals, closed)) ++closed_days;
+            }
+            minutes = rollups.size();
+        }
+        recover_ms = seconds_since(start) * 1000.0;
+
+        // Эталон: те же интервалы прямо по сырым замерам
+        for (const auto& sample : db.getSamples(hourly.openBucket().start_ms, last_ms, INT32_MAX)) {
+            open_hour.add(sample.value);
+        }
+        for (const auto& sample : db.getSamples(daily.openBucket().start_ms, last_ms, INT32_MAX)) {
+            open_day.add(sample.value);
+        }
+    }
+    remove_db(path);
+
+    auto same = [](const Accumulator& a, const Accumulator& b) {
+        return a.count == b.count && a.min == b.min && a.max == b.max &&
+               fabs(a.average() - b.average()) < 1e-9 && fabs(a.stddev() - b.stddev()) < 1e-6;
+    };
+    bool ok = same(hourly.openBucket().acc, open_hour) && same(daily.openBucket().acc, open_day);
+
+    cout << fixed << setprecision(3);
+    cout << "rows:                  " << total << "\n";
+    cout << "recovery:              " << recover_ms << " ms (" << minutes << " minute rollups, "
+         << closed_hours << " hours and " << closed_days << " days closed on the way)\n";
+    cout << "open hour:             " << hourly.openBucket().acc.count << " samples, avg "
+         << hourly.openBucket().acc.average() << "\n";
+    cout << "open day:              " << daily.openBucket().acc.count << " samples, avg "
+         << daily.openBucket().acc.average() << "\n";
+    cout << "matches raw rescan:    " << (ok ? "yes" : "NO") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// retention: очистка старых замеров на фоне записи
+// ---------------------------------------------------------------------------
+
+int bench_retention(int days) {
+    string path = temp_db_path("retention");
+    string copy_path = temp_db_path("retention_copy");
+    const int keep_days = RETENTION_KEEP_DAYS;
+    const int64_t total = days * 86400LL;
+    const int64_t first_ms = currentTimeMs() - total * MS_PER_SECOND;
+
+    RetentionWorker::Report report;
+    double single_delete_sec = 0, ingest_max_ms = 0;
+    int64_t bytes_before = 0, bytes_after = 0;
+    long ingested = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        batch.reserve(4096);
+        for (int64_t i = 0; i < total; ++i) {
+            Sample sample = { first_ms + i * MS_PER_SECOND, 20.0f + (i % 100) / 10.0f, 0 };
+            batch.push_back(sample);
+            if (batch.size() == batch.capacity()) {
+                db.insertSamples(batch);
+                batch.clear();
+            }
+        }
+        db.insertSamples(batch);
+        db.checkpoint();
+        bytes_before = db.fileBytes();
+
+        // Как было: один DELETE на весь хвост (на копии базы)
+        filesystem::copy_file(path, copy_path, filesystem::copy_options::overwrite_existing);
+        sqlite3* conn = nullptr;
+        sqlite3_open(copy_path.c_str(), &conn);
+        string sql = "DELETE FROM temperature_raw WHERE ts < " + to_string(Database::retentionCutoffMs(keep_days));
+        auto start = chrono::steady_clock::now();
+        sqlite3_exec(conn, sql.c_str(), nullptr, nullptr, nullptr);
+        single_delete_sec = seconds_since(start);
+        sqlite3_close(conn);
+
+        // Запись пачками по 10 замеров каждые 10 мс, пока идет очистка
+        atomic<bool> done(false);
+        thread ingest([&]() {
+            int64_t ts = currentTimeMs();
+            while (!done) {
+                vector<Sample> samples;
+                for (int i = 0; i < 10; ++i) {
+                    Sample sample = { ts++, 21.0f, 0 };
+                    samples.push_back(sample);
+                }
+                auto insert_start = chrono::steady_clock::now();
+                db.insertSamples(samples);
+                ingest_max_ms = max(ingest_max_ms, seconds_since(insert_start) * 1000.0);
+                ingested += 10;
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }
+        });
+
+        RetentionWorker worker(db, keep_days);
+        report = worker.runPass();
+        done = true;
+        ingest.join();
+        bytes_after = db.fileBytes();
+    }
+    remove_db(path);
+    remove_db(copy_path);
+
+    cout << fixed << setprecision(2);
+    cout << "rows:                  " << total << " (" << days << " days, keeping " << keep_days << ")\n";
+    cout << "single DELETE:         " << single_delete_sec * 1000 << " ms holding the write lock\n";
+    cout << "retention pass:        " << report.rows_deleted << " rows in " << report.batches << " batches, "
+         << report.seconds << " s, longest batch " << report.longest_batch_ms << " ms\n";
+    cout << "ingest during pass:    " << ingested << " samples, max insert " << ingest_max_ms << " ms\n";
+    cout << "file:                  " << bytes_before / 1e6 << " MB -> " << bytes_after / 1e6
+         << " MB (reported " << report.bytes_reclaimed / 1e6 << " MB reclaimed)\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// readers: задержка чтения без записи и при непрерывной записи
+// ---------------------------------------------------------------------------
+
+int bench_readers(int threads, double seconds) {
+    string path = temp_db_path("readers");
+    const int64_t total = 86400;
+    const int64_t first_ms = 1704067200000LL;
+    const int64_t last_ms = first_ms + (total - 1) * MS_PER_SECOND;
+
+    struct Load { vector<double> latencies_ms; long inserted; };
+    Load idle = { {}, 0 }, saturated = { {}, 0 };
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        vector<Sample> batch;
+        for (int64_t i = 0; i < total; ++i) {
+            Sample sample = { first_ms + i * MS_PER_SECOND, 20.0f + (i % 100) / 10.0f, 0 };
+            batch.push_back(sample);
+        }
+        db.insertSamples(batch);
+
+        // Запросы как у API: последние замеры и статистика за невыровненный час
+        auto run = [&](bool ingest, Load& load) {
+            atomic<bool> stop(false);
+            atomic<int64_t> next_ts(last_ms + MS_PER_SECOND);
+            atomic<long> inserted(0);
+            mutex latency_mutex;
+            vector<thread> workers;
+
+            if (ingest) {
+                workers.emplace_back([&]() {
+                    vector<Sample> samples(256);
+                    while (!stop) {
+                        for (auto& sample : samples) {
+                            sample.ts_ms = next_ts++;
+                            sample.value = 21.0f;
+                            sample.sensor_id = 0;
+                        }
+                        db.insertSamples(samples);
+                        inserted += samples.size();
+                    }
+                });
+            }
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t]() {
+                    vector<double> latencies;
+                    for (int i = 0; !stop; ++i) {
+                        auto start = chrono::steady_clock::now();
+                        if ((i + t) % 2 == 0) {
+                            db.getSamples(last_ms - MS_PER_HOUR, last_ms, 1000);
+                        } else {
+                            db.getStatistics(last_ms - MS_PER_HOUR - 12345, last_ms - 6789);
+                        }
+                        latencies.push_back(seconds_since(start) * 1000.0);
+                    }
+                    lock_guard<mutex> lock(latency_mutex);
+                    load.latencies_ms.insert(load.latencies_ms.end(), latencies.begin(), latencies.end());
+                });
+            }
+
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            stop = true;
+            for (auto& worker : workers) worker.join();
+            load.inserted = inserted;
+        };
+
+        run(false, idle);
+        run(true, saturated);
+    }
+    remove_db(path);
+
+    cout << fixed << setprecision(3);
+    cout << "read threads:          " << threads << "\n";
+    cout << "idle:                  " << idle.latencies_ms.size() / seconds << " reads/s, p50 "
+         << percentile(idle.latencies_ms, 0.5) << " ms, p99 " << percentile(idle.latencies_ms, 0.99) << " ms\n";
+    cout << "ingest saturated:      " << saturated.latencies_ms.size() / seconds << " reads/s, p50 "
+         << percentile(saturated.latencies_ms, 0.5) << " ms, p99 " << percentile(saturated.latencies_ms, 0.99)
+         << " ms (" << setprecision(0) << saturated.inserted / seconds << " samples/s written)\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// writer: сколько ждет поток чтения порта, пока база занята
+// ---------------------------------------------------------------------------
+
+// Производитель кладет rate замеров в секунду, а раз в секунду другой
+// поток занимает базу большой транзакцией (как очистка или checkpoint).
+// mode: sync - прежняя запись пачками по 256 прямо из потока чтения,
+// иначе - через SampleWriter с маленькой очередью и заданной политикой
+int bench_writer(const string& mode, SampleWriter::Backpressure policy, int rate, double seconds) {
+    string path = temp_db_path("writer");
+    const int64_t first_ms = 1704067200000LL;
+    const size_t queue_capacity = 4096;
+    const size_t stall_rows = 200000;
+
+    vector<double> push_us;
+    double max_stall_ms = 0;
+    double stall_ms = 0;
+    SampleWriter::Stats stats = {};
+    long produced = 0;
+    int stored = 0;
+    {
+        SilentCout silent;
+        Database db;
+        if (!db.open(path)) return 1;
+
+        SampleWriter writer(db, queue_capacity);
+        writer.setBackpressure(policy);
+        writer.setSpillPath(path + "-spill");
+        if (mode != "sync") writer.start();
+
+        atomic<bool> stop(false);
+        thread staller([&]() {
+            vector<Sample> rows(stall_rows);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                rows[i].ts_ms = first_ms - 10 * MS_PER_DAY + static_cast<int64_t>(i);
+                rows[i].value = 20.0f;
+                rows[i].sensor_id = 0;
+            }
+            while (!stop) {
+                this_thread::sleep_for(chrono::milliseconds(500));
+                if (stop) break;
+                auto start = chrono::steady_clock::now();
+                db.insertSamples(rows);
+                stall_ms = max(stall_ms, seconds_since(start) * 1000.0);
+                for (auto& row : rows) row.ts_ms -= stall_rows;
+            }
+        });
+
+        vector<Sample> pending;
+        auto started = chrono::steady_clock::now();
+        auto tick = started;
+        while (seconds_since(started) < seconds) {
+            tick += chrono::milliseconds(1);
+            this_thread::sleep_until(tick);
+
+            long due = static_cast<long>(seconds_since(started) * rate);
+            for (; produced < due; ++produced) {
+                Sample sample = { first_ms + produced, 21.0f, 0 };
+                auto start = chrono::steady_clock::now();
+                if (mode == "sync") {
+                    pending.push_back(sample);
+                    if (pending.size() >= 256) {
+                        db.insertSamples(pending);
+                        pending.clear();
+                    }
+                } else {
+                    writer.push(sample);
+                }
+                double us = seconds_since(start) * 1e6;
+                push_us.push_back(us);
+                max_stall_ms = max(max_stall_ms, us / 1000.0);
+            }
+        }
+
+        stop = true;
+        staller.join();
+        if (mode == "sync") {
+            db.insertSamples(pending);
+        } else {
+            writer.stop();
+        }
+        stats = writer.stats();
+        stored = db.getStatistics(first_ms, first_ms + produced).sample_count;
+    }
+    remove_db(path);
+
+    cout << fixed << setprecision(3);
+    cout << setw(12) << left << mode << right
+         << " push p50 " << setw(7) << percentile(push_us, 0.5) << " us, p99.9 " << setw(9)
+         << percentile(push_us, 0.999) << " us, max " << setw(8) << max_stall_ms << " ms | stored "
+         << stored << "/" << produced;
+    if (mode != "sync") {
+        cout << ", max depth " << stats.max_depth << ", dropped " << stats.dropped << ", spilled "
+             << stats.spilled << ", waits " << stats.blocked;
+    }
+    cout << " (db stall " << setprecision(0) << stall_ms << " ms)\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// reactor: много портов одним потоком через epoll против потока на порт
+// ---------------------------------------------------------------------------
+
+// Виртуальное устройство на паре pty: в ведущую сторону пишет генератор,
+// ведомая открывается как обычный последовательный порт
+struct PtyDevice {
+    int master;
+    cplib::SerialPort port;
+
+    PtyDevice() : master(-1) {}
+    ~PtyDevice() {
+        port.Close();
+        if (master >= 0) close(master);
+    }
+};
+
+bool open_pty(PtyDevice& device) {
+    device.master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (device.master < 0 || grantpt(device.master) != 0 || unlockpt(device.master) != 0) return false;
+
+    const char* name = ptsname(device.master);
+    cplib::SerialPort::Parameters params("115200");
+    return name && device.port.Open(name, params) == cplib::SerialPort::RE_OK;
+}
+
+// Время процессора и переключения контекста текущего потока
+struct ThreadUsage {
+    double cpu_seconds;
+    long switches;
+
+    static ThreadUsage now() {
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+        ThreadUsage result;
+        result.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                             (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+        result.switches = usage.ru_nvcsw + usage.ru_nivcsw;
+        return result;
+    }
+};
+
+// rate - строк в секунду на устройство, 0 - генератор пишет без пауз и
+// упирается в читателей (блокирующая запись в pty). Все потоки процесса
+// на одном ядре
+int bench_reactor_mode(const string& mode, int devices, int rate, double seconds) {
+    vector<unique_ptr<PtyDevice>> ptys;
+    for (int i = 0; i < devices; ++i) {
+        ptys.emplace_back(new PtyDevice());
+        if (!open_pty(*ptys.back())) {
+            cerr << "Failed to open pty pair " << i << "\n";
+            return 1;
+        }
+    }
+
+    // Пачка строк эмулятора: генератор только копирует готовые байты
+    const int lines_per_write = 16;
+    string chunk;
+    char line[128];
+    for (int i = 0; i < lines_per_write; ++i) {
+        double temp = 20.0 + i / 10.0;
+        int len = snprintf(line, sizeof(line),
+                           "{\"temperature\": %.2f, \"timestamp\": \"2024-01-01 12:00:%02d.000\", \"checksum\": %.2f}\n",
+                           temp, i, temp);
+        chunk.append(line, len);
+    }
+
+    atomic<bool> reading(true);
+    atomic<long> received(0);
+    mutex usage_mutex;
+    ThreadUsage readers = { 0, 0 };
+    auto add_usage = [&]() {
+        ThreadUsage usage = ThreadUsage::now();
+        lock_guard<mutex> lock(usage_mutex);
+        readers.cpu_seconds += usage.cpu_seconds;
+        readers.switches += usage.switches;
+    };
+
+    vector<thread> threads;
+    if (mode == "reactor") {
+        threads.emplace_back([&]() {
+            SerialReactor reactor;
+            for (auto& pty : ptys) {
+                pty->port.SetNonBlocking(true);
+                reactor.add(pty->port, [&](string_view text) {
+                    Sample sample;
+                    if (parseSample(text, 0, sample) == PARSE_OK) received.fetch_add(1, memory_order_relaxed);
+                });
+            }
+            while (reading) reactor.poll(100);
+            add_usage();
+        });
+    } else {
+        // Как раньше в логгере: блокирующее чтение с таймаутом VTIME
+        for (auto& pty : ptys) {
+            cplib::SerialPort* port = &pty->port;
+            port->SetTimeout(0.1);
+            threads.emplace_back([&, port]() {
+                LineFramer framer(REACTOR_FRAMER_CAPACITY);
+                while (reading) {
+                    size_t n = 0;
+                    if (port->Read(framer.writePtr(), framer.writable(), &n) != cplib::SerialPort::RE_OK) break;
+                    framer.commit(n);
+
+                    string_view text;
+                    while (framer.next(text)) {
+                        Sample sample;
+                        if (parseSample(text, 0, sample) == PARSE_OK) received.fetch_add(1, memory_order_relaxed);
+                    }
+                }
+                add_usage();
+            });
+        }
+    }
+
+    long sent = 0;
+    auto started = chrono::steady_clock::now();
+    auto tick = started;
+    while (seconds_since(started) < seconds) {
+        if (rate > 0) {
+            tick += chrono::milliseconds(1);
+            this_thread::sleep_until(tick);
+        }
+        long due = rate > 0 ? static_cast<long>(seconds_since(started) * rate) : sent / devices + lines_per_write;
+        while (sent / devices + lines_per_write <= due) {
+            for (auto& pty : ptys) {
+                if (write(pty->master, chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size())) {
+                    cerr << "Short write to pty\n";
+                    reading = false;
+                    break;
+                }
+            }
+            sent += static_cast<long>(lines_per_write) * devices;
+        }
+    }
+    double elapsed = seconds_since(started);
+
+    // Даем дочитать то, что уже в буферах pty
+    auto drain_started = chrono::steady_clock::now();
+    while (received < sent && seconds_since(drain_started) < 2.0) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    double busy = seconds_since(started);
+    reading = false;
+    for (auto& worker : threads) worker.join();
+
+    cout << fixed << setprecision(0);
+    cout << setw(8) << left << mode << right << setw(7) << (rate > 0 ? to_string(rate) + "/s" : "max")
+         << " | " << setw(4) << threads.size() << " threads | " << setw(9) << received / elapsed
+         << " lines/s (" << received << "/" << sent << ") | cpu " << setw(5) << setprecision(1)
+         << readers.cpu_seconds / busy * 100 << "% | " << setprecision(2) << setw(5)
+         << (received > 0 ? readers.cpu_seconds * 1e6 / received : 0) << " us/line | "
+         << setprecision(0) << readers.switches / busy << " switches/s\n";
+    return received == sent ? 0 : 1;
+}
+
+int bench_reactor(int devices, int rate, double seconds) {
+    // Одно ядро на все: и генератор, и читатели
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                CPU_ZERO(&cpus);
+                CPU_SET(cpu, &cpus);
+                sched_setaffinity(0, sizeof(cpus), &cpus);
+                break;
+            }
+        }
+    }
+
+    cout << "devices: " << devices << " pty pairs, " << seconds << " s per run, one core\n";
+    int result = bench_reactor_mode("threads", devices, rate, seconds);
+    result |= bench_reactor_mode("reactor", devices, rate, seconds);
+    result |= bench_reactor_mode("threads", devices, 0, seconds);
+    result |= bench_reactor_mode("reactor", devices, 0, seconds);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    string mode = argc > 1 ? argv[1] : "";
+
+    if (mode == "db") {
+        return bench_db(argc > 2 ? atoi(argv[2]) : 50000);
+    }
+    if (mode == "range") {
+        return bench_range(argc > 2 ? atoi(argv[2]) : 30);
+    }
+
+    if (mode == "framer") {
+        return bench_framer(argc > 2 ? atoi(argv[2]) : 8,
+                            argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 65536);
+    }
+
+    if (mode == "parser") {
+        return bench_parser(argc > 2 ? atoi(argv[2]) : 1000000);
+    }
+
+    if (mode == "http") {
+        return bench_http(argc > 2 ? atoi(argv[2]) : 16, argc > 3 ? atof(argv[3]) : 3.0,
+                          argc > 4 ? atoi(argv[4]) : 8);
+    }
+
+    if (mode == "cache") {
+        return bench_cache(argc > 2 ? atoi(argv[2]) : 16, argc > 3 ? atof(argv[3]) : 3.0);
+    }
+
+    if (mode == "stream") {
+        return bench_stream(argc > 2 ? atoi(argv[2]) : 200, argc > 3 ? atoi(argv[3]) : 1000,
+                            argc > 4 ? atof(argv[4]) : 5.0);
+    }
+
+    if (mode == "export") {
+        return bench_export(argc > 2 ? atoi(argv[2]) : 30);
+    }
+
+    if (mode == "columnar") {
+        return bench_columnar(argc > 2 ? atoi(argv[2]) : 100000);
+    }
+
+    if (mode == "writer") {
+        int rate = argc > 2 ? atoi(argv[2]) : 20000;
+        double seconds = argc > 3 ? atof(argv[3]) : 3.0;
+        bench_writer("sync", SampleWriter::BACKPRESSURE_BLOCK, rate, seconds);
+        bench_writer("block", SampleWriter::BACKPRESSURE_BLOCK, rate, seconds);
+        bench_writer("drop-oldest", SampleWriter::BACKPRESSURE_DROP_OLDEST, rate, seconds);
+        return bench_writer("spill", SampleWriter::BACKPRESSURE_SPILL, rate, seconds);
+    }
+
+    if (mode == "reactor") {
+        return bench_reactor(argc > 2 ? atoi(argv[2]) : 100, argc > 3 ? atoi(argv[3]) : 100,
+                             argc > 4 ? atof(argv[4]) : 3.0);
+    }
+
+    if (mode == "readers") {
+        return bench_readers(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atof(argv[3]) : 3.0);
+    }
+
+    if (mode == "retention") {
+        return bench_retention(argc > 2 ? atoi(argv[2]) : 35);
+    }
+
+    if (mode == "recover") {
+        return bench_recover(argc > 2 ? atoi(argv[2]) : 30);
+    }
+
+    if (mode == "series") {
+        return bench_series(argc > 2 ? atoi(argv[2]) : 30, argc > 3 ? atoi(argv[3]) : 2000);
+    }
+
+    cout << "Usage: " << argv[0] << " db [count] | range [days] | framer [MB] [chunk] | parser [fuzz lines]"
+         << " | http [clients] [seconds] [statistics clients] | cache [clients] [seconds]"
+         << " | stream [subscribers] [samples/s] [seconds] | export [days]"
+         << " | columnar [samples] | series [days] [points] | recover [days]"
+         << " | retention [days] | readers [threads] [seconds]"
+         << " | writer [rate] [seconds] | reactor [devices] [lines/s per device] [seconds]\n";
+    return 1;
+}
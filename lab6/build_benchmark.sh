@@ -0,0 +1,3 @@
+#!/bin/sh
+# Бенчмарки собираются отдельно от сервера, sqlite берем системный
+g++ -std=c++17 -O2 -I. benchmark.cpp -lsqlite3 -pthread -o benchmark
@@ -0,0 +1,97 @@
+#ifndef COLUMNAR_HPP
+#define COLUMNAR_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// Двоичный колоночный формат выборки замеров (ответ на
+// Accept: application/x-temp-columnar). Порядок байт - little-endian,
+// как на всех платформах, где собираются сервер и окно.
+//
+//     0   char[4]   "TMPC"
+//     4   uint16    версия (1)
+//     6   uint16    размер заголовка (16) - новые поля дописываются в конец
+//     8   uint32    число замеров n
+//     12  uint32    0
+//     16  int64[n]  время в мс: первое целиком, дальше разность с предыдущим
+//     ..  float[n]  значения
+//
+// Заголовок кратен 8, поэтому колонка времени выровнена
+
+#define COLUMNAR_CONTENT_TYPE "application/x-temp-columnar"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_HEADER_SIZE 16
+
+namespace columnar_detail {
+
+template <typename T>
+inline void put(std::string& out, size_t offset, T value) {
+    memcpy(&out[offset], &value, sizeof(value));
+}
+
+template <typename T>
+inline T get(const char* data) {
+    T value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+}
+
+// Samples - любой контейнер с полями ts_ms и value у элементов
+template <typename Samples>
+inline std::string encodeColumnar(const Samples& samples) {
+    using namespace columnar_detail;
+
+    uint32_t count = static_cast<uint32_t>(samples.size());
+    std::string out(COLUMNAR_HEADER_SIZE + count * (sizeof(int64_t) + sizeof(float)), '\0');
+
+    memcpy(&out[0], "TMPC", 4);
+    put<uint16_t>(out, 4, COLUMNAR_VERSION);
+    put<uint16_t>(out, 6, COLUMNAR_HEADER_SIZE);
+    put<uint32_t>(out, 8, count);
+
+    size_t ts_offset = COLUMNAR_HEADER_SIZE;
+    size_t value_offset = ts_offset + count * sizeof(int64_t);
+    int64_t previous = 0;
+    for (const auto& sample : samples) {
+        put<int64_t>(out, ts_offset, sample.ts_ms - previous);
+        put<float>(out, value_offset, sample.value);
+        previous = sample.ts_ms;
+        ts_offset += sizeof(int64_t);
+        value_offset += sizeof(float);
+    }
+
+    return out;
+}
+
+// Разбор ответа: emit(ts_ms, value) для каждого замера по порядку.
+// false - не тот формат или данные обрезаны
+template <typename Emit>
+inline bool decodeColumnar(const char* data, size_t size, Emit emit) {
+    using namespace columnar_detail;
+
+    if (size < COLUMNAR_HEADER_SIZE || memcmp(data, "TMPC", 4) != 0) return false;
+    if (get<uint16_t>(data + 4) != COLUMNAR_VERSION) return false;
+
+    size_t header_size = get<uint16_t>(data + 6);
+    uint64_t count = get<uint32_t>(data + 8);
+    if (header_size < COLUMNAR_HEADER_SIZE ||
+        size < header_size + count * (sizeof(int64_t) + sizeof(float))) {
+        return false;
+    }
+
+    const char* ts_column = data + header_size;
+    const char* value_column = ts_column + count * sizeof(int64_t);
+    int64_t ts_ms = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        ts_ms += get<int64_t>(ts_column + i * sizeof(int64_t));
+        emit(ts_ms, get<float>(value_column + i * sizeof(float)));
+    }
+
+    return true;
+}
+
+#endif
@@ -5,17 +5,378 @@
 #include <vector>
 #include <functional>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <memory>
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <utility>
 #include <iostream>
 #include <iomanip>
 #include <ctime>
 #include "sqlite3.h"
+#include "time_utils.hpp"
+#include "sample.hpp"
+#include "aggregator.hpp"
+
+// Текущая версия схемы (PRAGMA user_version)
+#define DB_SCHEMA_VERSION 4
+
+// Соединений только для чтения (по одному на поток пула HTTP)
+#define DB_READ_CONNECTIONS 4
+#define DB_BUSY_TIMEOUT_MS 1000     // ожидание читателя, если WAL на миг занят
 
 class Database {
 private:
+    // Запросы, которые компилируются один раз в open()
+    enum StatementId {
+        STMT_INSERT_RAW = 0,
+        STMT_INSERT_HOURLY,
+        STMT_INSERT_DAILY,
+        STMT_SELECT_RAW,
+        STMT_SELECT_RAW_PAGE,
+        STMT_SELECT_HOURLY,
+        STMT_SELECT_DAILY,
+        STMT_SELECT_CURRENT,
+        STMT_SELECT_STATISTICS,
+        STMT_UPSERT_ROLLUP,
+        STMT_SELECT_ROLLUP_STATISTICS,
+        STMT_SELECT_ROLLUPS,
+        STMT_SELECT_LAST_ROLLUP,
+        STMT_CLEANUP_RAW,
+        STMT_CLEANUP_ROLLUP,
+        STMT_INSERT_SENSOR,
+        STMT_NAME_SENSOR,
+        STMT_SELECT_SENSORS,
+        STMT_BEGIN,
+        STMT_COMMIT,
+        STMT_ROLLBACK,
+        STMT_COUNT
+    };
+    
+    static const char* statementSql(StatementId id) {
+        switch (id) {
+            case STMT_INSERT_RAW: return R"(
+                INSERT INTO temperature_raw (sensor_id, ts, temperature)
+                VALUES (?, ?, ?)
+            )";
+            case STMT_INSERT_HOURLY: return R"(
+                INSERT OR REPLACE INTO temperature_hourly
+                (sensor_id, timestamp, avg_temperature, min_temperature, max_temperature, sample_count)
+                VALUES (?, ?, ?, ?, ?, ?)
+            )";
+            case STMT_INSERT_DAILY: return R"(
+                INSERT OR REPLACE INTO temperature_daily
+                (sensor_id, date, avg_temperature, min_temperature, max_temperature, sample_count)
+                VALUES (?, ?, ?, ?, ?, ?)
+            )";
+            case STMT_SELECT_RAW: return R"(
+                SELECT ts, temperature
+                FROM temperature_raw
+                WHERE sensor_id = ? AND ts BETWEEN ? AND ?
+                ORDER BY ts DESC
+                LIMIT ?
+            )";
+            // Следующая страница после строки (ts, temperature, id) предыдущей.
+            // Порядок совпадает с индексом, поэтому обходится без сортировки
+            case STMT_SELECT_RAW_PAGE: return R"(
+                SELECT ts, temperature, id
+                FROM temperature_raw
+                WHERE sensor_id = ?6 AND ts >= ?1 AND ts <= ?2
+                  AND (ts < ?2 OR temperature < ?3 OR (temperature = ?3 AND id < ?4))
+                ORDER BY ts DESC, temperature DESC, id DESC
+                LIMIT ?5
+            )";
+            case STMT_SELECT_HOURLY: return R"(
+                SELECT timestamp, avg_temperature
+                FROM temperature_hourly
+                WHERE sensor_id = ? AND date(timestamp) BETWEEN ? AND ?
+                ORDER BY timestamp
+            )";
+            case STMT_SELECT_DAILY: return R"(
+                SELECT date, avg_temperature
+                FROM temperature_daily
+                WHERE sensor_id = ? AND date BETWEEN ? AND ?
+                ORDER BY date
+            )";
+            case STMT_SELECT_CURRENT: return R"(
+                SELECT temperature
+                FROM temperature_raw
+                WHERE sensor_id = ?
+                ORDER BY ts DESC
+                LIMIT 1
+            )";
+            // Края диапазона, не покрытые сводками: [?2, ?3)
+            case STMT_SELECT_STATISTICS: return R"(
+                SELECT
+                    COUNT(*),
+                    SUM(temperature),
+                    MIN(temperature),
+                    MAX(temperature),
+                    SUM(temperature * temperature)
+                FROM temperature_raw
+                WHERE sensor_id = ? AND ts >= ? AND ts < ?
+            )";
+            case STMT_UPSERT_ROLLUP: return R"(
+                INSERT INTO temperature_rollup
+                (sensor_id, resolution, bucket, sample_count, sum_temperature,
+                 min_temperature, max_temperature, sumsq_temperature)
+                VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+                ON CONFLICT (sensor_id, resolution, bucket) DO UPDATE SET
+                    sample_count = sample_count + excluded.sample_count,
+                    sum_temperature = sum_temperature + excluded.sum_temperature,
+                    min_temperature = MIN(min_temperature, excluded.min_temperature),
+                    max_temperature = MAX(max_temperature, excluded.max_temperature),
+                    sumsq_temperature = sumsq_temperature + excluded.sumsq_temperature
+            )";
+            // Сводки датчика ?1 одного разрешения с началом в [?3, ?4)
+            case STMT_SELECT_ROLLUP_STATISTICS: return R"(
+                SELECT
+                    SUM(sample_count),
+                    SUM(sum_temperature),
+                    MIN(min_temperature),
+                    MAX(max_temperature),
+                    SUM(sumsq_temperature)
+                FROM temperature_rollup
+                WHERE sensor_id = ? AND resolution = ? AND bucket >= ? AND bucket < ?
+            )";
+            case STMT_SELECT_ROLLUPS: return R"(
+                SELECT bucket, sample_count, sum_temperature,
+                       min_temperature, max_temperature, sumsq_temperature
+                FROM temperature_rollup
+                WHERE sensor_id = ? AND resolution = ? AND bucket >= ? AND bucket < ?
+                ORDER BY bucket
+            )";
+            case STMT_SELECT_LAST_ROLLUP: return R"(
+                SELECT MAX(bucket)
+                FROM temperature_rollup
+                WHERE sensor_id = ? AND resolution = ?
+            )";
+            // Порция удаления: не больше ?2 строк раньше ?1, по датчикам
+            // из sensor и у каждого от самых старых по индексу. CROSS JOIN
+            // оставляет sensor внешним циклом, иначе SQLite может выбрать
+            // полный просмотр temperature_raw
+            case STMT_CLEANUP_RAW: return R"(
+                DELETE FROM temperature_raw
+                WHERE id IN (SELECT raw.id
+                             FROM sensor CROSS JOIN temperature_raw AS raw
+                             ON raw.sensor_id = sensor.id AND raw.ts < ?1
+                             LIMIT ?2)
+            )";
+            case STMT_CLEANUP_ROLLUP: return R"(
+                DELETE FROM temperature_rollup
+                WHERE (sensor_id, resolution, bucket) IN (
+                    SELECT rollup.sensor_id, rollup.resolution, rollup.bucket
+                    FROM sensor CROSS JOIN temperature_rollup AS rollup
+                    ON rollup.sensor_id = sensor.id AND rollup.resolution = ?1 AND rollup.bucket < ?2
+                    LIMIT ?3)
+            )";
+            case STMT_INSERT_SENSOR: return R"(
+                INSERT OR IGNORE INTO sensor (id) VALUES (?)
+            )";
+            case STMT_NAME_SENSOR: return R"(
+                INSERT INTO sensor (id, name) VALUES (?, ?)
+                ON CONFLICT (id) DO UPDATE SET name = excluded.name
+            )";
+            case STMT_SELECT_SENSORS: return R"(
+                SELECT id, name FROM sensor ORDER BY id
+            )";
+            case STMT_BEGIN: return "BEGIN IMMEDIATE";
+            case STMT_COMMIT: return "COMMIT";
+            case STMT_ROLLBACK: return "ROLLBACK";
+            default: return nullptr;
+        }
+    }
+    
+    // Сбрасывает закэшированный запрос при выходе из области видимости,
+    // чтобы незавершенный SELECT не держал читающую транзакцию
+    class CachedStatement {
+    public:
+        explicit CachedStatement(sqlite3_stmt* stmt) : stmt(stmt) {}
+        ~CachedStatement() {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+        sqlite3_stmt* get() const { return stmt; }
+    
+    private:
+        sqlite3_stmt* stmt;
+        
+        CachedStatement(const CachedStatement&);
+        CachedStatement& operator=(const CachedStatement&);
+    };
+    
+    // Разрешения сводок temperature_rollup, от грубого к мелкому. Границы
+    // кратны ширине от эпохи (UTC), поэтому мелкие корзины целиком лежат
+    // в крупных и диапазон собирается из них без пересечений
+    enum RollupLevel {
+        ROLLUP_DAY = 0,
+        ROLLUP_HOUR,
+        ROLLUP_MINUTE,
+        ROLLUP_LEVELS
+    };
+    
+    static int64_t rollupWidth(int level) {
+        switch (level) {
+            case ROLLUP_DAY: return MS_PER_DAY;
+            case ROLLUP_HOUR: return MS_PER_HOUR;
+            default: return MS_PER_MINUTE;
+        }
+    }
+    
+    // Кусок диапазона статистики: сводки уровня level или сырые замеры
+    // (level == ROLLUP_LEVELS) с началом в [from_ms, to_ms)
+    struct RangePart {
+        int level;
+        int64_t from_ms;
+        int64_t to_ms;
+    };
+    
+    // Соединение для записи: одно, под db_mutex
     sqlite3* db;
+    sqlite3_stmt* statements[STMT_COUNT];
     std::mutex db_mutex;
     
+    // Соединения только для чтения. В режиме WAL читатели видят последний
+    // закоммиченный снимок и не ждут писателя, а писатель не ждет их.
+    // Свободные лежат в idle_readers, занятое соединение принадлежит одному потоку
+    struct ReadConnection {
+        sqlite3* db;
+        sqlite3_stmt* statements[STMT_COUNT];
+        
+        ReadConnection() : db(nullptr) {
+            for (int i = 0; i < STMT_COUNT; ++i) statements[i] = nullptr;
+        }
+    };
+    
+    std::vector<std::unique_ptr<ReadConnection>> readers;
+    std::vector<ReadConnection*> idle_readers;
+    std::mutex readers_mutex;
+    std::condition_variable reader_released;
+    bool readers_closing;   // новые чтения идут через соединение записи
+    
+    // Соединение для одного чтения: из пула, а если пула нет (база в памяти
+    // или читатели не открылись) - соединение записи под db_mutex
+    class ReadLease {
+    public:
+        explicit ReadLease(Database& owner) : owner(owner), conn(owner.acquireReader()) {
+            if (!conn) writer_lock = std::unique_lock<std::mutex>(owner.db_mutex);
+        }
+        
+        ~ReadLease() {
+            if (conn) owner.releaseReader(conn);
+        }
+        
+        explicit operator bool() const { return conn != nullptr || owner.db != nullptr; }
+        
+        sqlite3_stmt* statement(StatementId id) const {
+            return conn ? conn->statements[id] : owner.statements[id];
+        }
+    
+    private:
+        Database& owner;
+        ReadConnection* conn;
+        std::unique_lock<std::mutex> writer_lock;
+        
+        ReadLease(const ReadLease&);
+        ReadLease& operator=(const ReadLease&);
+    };
+    
+    // Растет, когда меняется прошлое: при удалении старых замеров и минутных
+    // сводок и при записи замеров старше уже записанных (файл переполнения)
+    std::atomic<uint64_t> data_epoch;
+    
+    // Метка самого нового записанного замера
+    std::atomic<int64_t> written_through_ms;
+    
+    // Растет при каждой записи новых замеров
+    std::atomic<uint64_t> write_count;
+    
+    static bool prepareStatements(sqlite3* conn, sqlite3_stmt** stmts) {
+        for (int i = 0; i < STMT_COUNT; ++i) {
+            const char* sql = statementSql(static_cast<StatementId>(i));
+            if (sqlite3_prepare_v2(conn, sql, -1, &stmts[i], nullptr) != SQLITE_OK) {
+                std::cerr << sqlite3_errmsg(conn) << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    static void finalizeStatements(sqlite3_stmt** stmts) {
+        for (int i = 0; i < STMT_COUNT; ++i) {
+            if (stmts[i]) {
+                sqlite3_finalize(stmts[i]);
+                stmts[i] = nullptr;
+            }
+        }
+    }
+    
+    // Открывает читателей к уже созданной схеме. Не открылись - читаем
+    // через соединение записи, как раньше
+    void openReaders(const std::string& filename) {
+        if (filename.empty() || filename == ":memory:") return;
+        
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        readers_closing = false;
+        for (int i = 0; i < DB_READ_CONNECTIONS; ++i) {
+            std::unique_ptr<ReadConnection> reader(new ReadConnection());
+            int rc = sqlite3_open_v2(filename.c_str(), &reader->db,
+                                     SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+            if (rc != SQLITE_OK || !prepareStatements(reader->db, reader->statements)) {
+                std::cerr << "Read connection failed: " << sqlite3_errmsg(reader->db) << "\n";
+                finalizeStatements(reader->statements);
+                sqlite3_close(reader->db);
+                break;
+            }
+            sqlite3_busy_timeout(reader->db, DB_BUSY_TIMEOUT_MS);
+            
+            idle_readers.push_back(reader.get());
+            readers.push_back(std::move(reader));
+        }
+    }
+    
+    // Дожидается возврата всех читателей и закрывает их. Кто ждал свободного
+    // читателя, уходит на соединение записи
+    void closeReaders() {
+        {
+            std::unique_lock<std::mutex> lock(readers_mutex);
+            readers_closing = true;
+            reader_released.notify_all();
+            reader_released.wait(lock, [this]() { return idle_readers.size() == readers.size(); });
+            
+            for (auto& reader : readers) {
+                finalizeStatements(reader->statements);
+                sqlite3_close(reader->db);
+            }
+            idle_readers.clear();
+            readers.clear();
+        }
+        reader_released.notify_all();
+    }
+    
+    // nullptr - пула нет или он закрывается
+    ReadConnection* acquireReader() {
+        std::unique_lock<std::mutex> lock(readers_mutex);
+        if (readers.empty() || readers_closing) return nullptr;
+        
+        reader_released.wait(lock, [this]() { return readers_closing || !idle_readers.empty(); });
+        if (readers_closing) return nullptr;
+        ReadConnection* reader = idle_readers.back();
+        idle_readers.pop_back();
+        return reader;
+    }
+    
+    void releaseReader(ReadConnection* reader) {
+        {
+            std::lock_guard<std::mutex> lock(readers_mutex);
+            idle_readers.push_back(reader);
+        }
+        reader_released.notify_all();
+    }
+    
 public:
     struct TemperatureRecord {
         std::string timestamp;
@@ -29,19 +390,44 @@ public:
             : timestamp(ts), temperature(temp), date(d), hour(h) {}
     };
     
+    // Позиция постраничного чтения замеров: последняя отданная строка
+    struct SampleCursor {
+        int64_t ts_ms;
+        double temperature;
+        int64_t id;
+        
+        SampleCursor() : ts_ms(INT64_MAX), temperature(HUGE_VAL), id(INT64_MAX) {}
+    };
+    
+    // Датчик: номер и имя порта, с которого он пишется (может быть пустым)
+    struct SensorInfo {
+        uint32_t id;
+        std::string name;
+    };
+    
+    // Минутная сводка: начало минуты и итоги замеров в ней
+    struct RollupBucket {
+        int64_t start_ms;
+        RollupTotals totals;
+    };
+    
     struct Statistics {
         double avg_temp;
         double min_temp;
         double max_temp;
         int sample_count;
+        double stddev_temp;
         
-        Statistics() : avg_temp(0), min_temp(0), max_temp(0), sample_count(0) {}
-        Statistics(double avg, double min, double max, int count) 
-            : avg_temp(avg), min_temp(min), max_temp(max), sample_count(count) {}
+        Statistics() : avg_temp(0), min_temp(0), max_temp(0), sample_count(0), stddev_temp(0) {}
+        Statistics(double avg, double min, double max, int count, double stddev = 0)
+            : avg_temp(avg), min_temp(min), max_temp(max), sample_count(count), stddev_temp(stddev) {}
     };
     
     // Конструктор
-    Database() : db(nullptr) {}
+    Database() : db(nullptr), readers_closing(false), data_epoch(0),
+                 written_through_ms(0), write_count(0) {
+        for (int i = 0; i < STMT_COUNT; ++i) statements[i] = nullptr;
+    }
     
     // Деструктор
     ~Database() { 
@@ -63,19 +449,33 @@ public:
         
         std::cout << "Database opened\n";
         
+        // Новый файл сразу с incremental auto_vacuum: место после удаления
+        // старых замеров возвращается порциями, без полного VACUUM
+        execute("PRAGMA auto_vacuum = INCREMENTAL");
         execute("PRAGMA foreign_keys = ON");
         execute("PRAGMA journal_mode = WAL");
         execute("PRAGMA synchronous = NORMAL");
         
         createTables();
         
+        if (!prepareStatements(db, statements)) {
+            finalizeStatements(statements);
+            sqlite3_close(db);
+            db = nullptr;
+            return false;
+        }
+        
+        openReaders(filename);
         return true;
     }
     
     void close() {
+        closeReaders();
+        
         std::lock_guard<std::mutex> lock(db_mutex);
         
         if (db) {
+            finalizeStatements(statements);
             sqlite3_close(db);
             db = nullptr;
             std::cout << "Database closed\n";
@@ -100,44 +500,259 @@ public:
         return true;
     }
     
-    void createTables() {
+    // Одно целое значение из запроса (PRAGMA, COUNT и т.п.)
+    int queryInt(const std::string& sql) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            std::cerr << sqlite3_errmsg(db) << "\n";
+            return 0;
+        }
+        
+        int result = 0;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            result = sqlite3_column_int(stmt, 0);
+        }
+        
+        sqlite3_finalize(stmt);
+        return result;
+    }
+    
+    bool hasColumn(const std::string& table, const std::string& column) {
+        return queryInt("SELECT COUNT(*) FROM pragma_table_info('" + table + "') WHERE name = '" +
+                        column + "'") > 0;
+    }
+    
+    void createRawTable() {
+        // Время хранится в мс от эпохи, индекс (sensor_id, ts, temperature)
+        // покрывает выборки датчика по диапазону и агрегаты без обращения
+        // к самой таблице
         execute(R"(
             CREATE TABLE IF NOT EXISTS temperature_raw (
                 id INTEGER PRIMARY KEY AUTOINCREMENT,
-                timestamp TEXT NOT NULL,
+                ts INTEGER NOT NULL,
                 temperature REAL NOT NULL,
-                date TEXT NOT NULL,
-                hour TEXT NOT NULL,
-                created_at DATETIME DEFAULT CURRENT_TIMESTAMP
+                sensor_id INTEGER NOT NULL DEFAULT 0
             )
         )");
         
+        execute(R"(
+            CREATE INDEX IF NOT EXISTS idx_temperature_raw_sensor_ts
+            ON temperature_raw (sensor_id, ts, temperature)
+        )");
+    }
+    
+    // Схема 0: timestamp/date/hour строками -> схема 1: ts INTEGER
+    void migrateRawToEpoch() {
+        std::cout << "Migrating temperature_raw to epoch timestamps\n";
+        
+        execute("BEGIN IMMEDIATE");
+        
+        bool ok = execute("ALTER TABLE temperature_raw RENAME TO temperature_raw_v0");
+        if (ok) {
+            createRawTable();
+            // Строки без разбираемого timestamp берут время из created_at (UTC)
+            ok = execute(R"(
+                INSERT INTO temperature_raw (id, ts, temperature)
+                SELECT id,
+                       CAST(ROUND((COALESCE(julianday(timestamp, 'utc'), julianday(created_at))
+                                   - 2440587.5) * 86400000.0) AS INTEGER),
+                       temperature
+                FROM temperature_raw_v0
+                WHERE COALESCE(julianday(timestamp, 'utc'), julianday(created_at)) IS NOT NULL
+            )") && execute("DROP TABLE temperature_raw_v0");
+        }
+        
+        if (ok) {
+            execute("COMMIT");
+        } else {
+            std::cerr << "Migration failed\n";
+            execute("ROLLBACK");
+        }
+    }
+    
+    // Сводки за минуту, час и сутки по temperature_raw. Обновляются в той же
+    // транзакции, что и вставка замеров, поэтому всегда с ней согласованы
+    void createRollupTable() {
+        execute(R"(
+            CREATE TABLE IF NOT EXISTS temperature_rollup (
+                sensor_id INTEGER NOT NULL,
+                resolution INTEGER NOT NULL,
+                bucket INTEGER NOT NULL,
+                sample_count INTEGER NOT NULL,
+                sum_temperature REAL NOT NULL,
+                min_temperature REAL NOT NULL,
+                max_temperature REAL NOT NULL,
+                sumsq_temperature REAL NOT NULL,
+                PRIMARY KEY (sensor_id, resolution, bucket)
+            ) WITHOUT ROWID
+        )");
+    }
+    
+    // Известные датчики. Строка появляется с первым замером датчика, по
+    // этому списку очистка обходит индексы temperature_raw
+    void createSensorTable() {
+        execute(R"(
+            CREATE TABLE IF NOT EXISTS sensor (
+                id INTEGER PRIMARY KEY,
+                name TEXT
+            )
+        )");
+    }
+    
+    void createAverageTables() {
         execute(R"(
             CREATE TABLE IF NOT EXISTS temperature_hourly (
                 id INTEGER PRIMARY KEY AUTOINCREMENT,
+                sensor_id INTEGER NOT NULL DEFAULT 0,
                 timestamp TEXT NOT NULL,
                 avg_temperature REAL NOT NULL,
                 min_temperature REAL NOT NULL,
                 max_temperature REAL NOT NULL,
                 sample_count INTEGER NOT NULL,
-                UNIQUE(timestamp)
+                UNIQUE(sensor_id, timestamp)
             )
         )");
         
         execute(R"(
             CREATE TABLE IF NOT EXISTS temperature_daily (
                 id INTEGER PRIMARY KEY AUTOINCREMENT,
+                sensor_id INTEGER NOT NULL DEFAULT 0,
                 date TEXT NOT NULL,
                 avg_temperature REAL NOT NULL,
                 min_temperature REAL NOT NULL,
                 max_temperature REAL NOT NULL,
                 sample_count INTEGER NOT NULL,
-                UNIQUE(date)
+                UNIQUE(sensor_id, date)
             )
         )");
     }
     
-    bool insertRawData(const TemperatureRecord& record) {
+    // Схема 3 -> 4: все накопленное становится датчиком 0. В temperature_raw
+    // столбец добавляется на месте, остальные таблицы пересоздаются - у них
+    // меняются ключ и UNIQUE
+    void migrateToSensors() {
+        // Таблица старой схемы: есть ключевой столбец, но нет sensor_id
+        auto outdated = [this](const char* table, const char* column) {
+            return hasColumn(table, column) && !hasColumn(table, "sensor_id");
+        };
+        const char* averages[][2] = { { "temperature_hourly", "timestamp" }, { "temperature_daily", "date" } };
+        
+        bool raw = outdated("temperature_raw", "ts");
+        bool rollup = outdated("temperature_rollup", "bucket");
+        bool hourly = outdated(averages[0][0], averages[0][1]);
+        bool daily = outdated(averages[1][0], averages[1][1]);
+        if (!raw && !rollup && !hourly && !daily) return;
+        
+        std::cout << "Adding sensor_id to temperature tables\n";
+        
+        execute("BEGIN IMMEDIATE");
+        
+        bool ok = true;
+        if (raw) {
+            ok = execute("ALTER TABLE temperature_raw ADD COLUMN sensor_id INTEGER NOT NULL DEFAULT 0") &&
+                 execute("DROP INDEX IF EXISTS idx_temperature_raw_ts");
+        }
+        
+        if (ok && rollup) {
+            ok = execute("ALTER TABLE temperature_rollup RENAME TO temperature_rollup_v3");
+            if (ok) {
+                createRollupTable();
+                ok = execute("INSERT INTO temperature_rollup SELECT 0, * FROM temperature_rollup_v3") &&
+                     execute("DROP TABLE temperature_rollup_v3");
+            }
+        }
+        
+        for (int i = 0; i < 2; ++i) {
+            if (!ok || !(i == 0 ? hourly : daily)) continue;
+            
+            std::string name = averages[i][0];
+            std::string columns = std::string("id, ") + averages[i][1] +
+                ", avg_temperature, min_temperature, max_temperature, sample_count";
+            ok = execute("ALTER TABLE " + name + " RENAME TO " + name + "_v3");
+            if (ok) {
+                createAverageTables();
+                ok = execute("INSERT INTO " + name + " (sensor_id, " + columns + ") "
+                             "SELECT 0, " + columns + " FROM " + name + "_v3") &&
+                     execute("DROP TABLE " + name + "_v3");
+            }
+        }
+        
+        if (ok) {
+            execute("COMMIT");
+        } else {
+            std::cerr << "Migration failed\n";
+            execute("ROLLBACK");
+        }
+    }
+    
+    // Схема 1 -> 2: сводки по уже накопленным замерам. Минутные считаются
+    // по temperature_raw, часовые - по минутным, суточные - по часовым
+    void backfillRollups() {
+        std::cout << "Building temperature_rollup from temperature_raw\n";
+        
+        execute("BEGIN IMMEDIATE");
+        
+        std::string minute = std::to_string(rollupWidth(ROLLUP_MINUTE));
+        bool ok = execute(
+            "INSERT OR REPLACE INTO temperature_rollup "
+            "SELECT sensor_id, " + minute + ", ts - ts % " + minute + ", COUNT(*), SUM(temperature), "
+            "MIN(temperature), MAX(temperature), SUM(temperature * temperature) "
+            "FROM temperature_raw GROUP BY 1, 3");
+        
+        for (int level = ROLLUP_HOUR; ok && level >= ROLLUP_DAY; --level) {
+            std::string width = std::to_string(rollupWidth(level));
+            std::string finer = std::to_string(rollupWidth(level + 1));
+            ok = execute(
+                "INSERT OR REPLACE INTO temperature_rollup "
+                "SELECT sensor_id, " + width + ", bucket - bucket % " + width + ", SUM(sample_count), "
+                "SUM(sum_temperature), MIN(min_temperature), MAX(max_temperature), SUM(sumsq_temperature) "
+                "FROM temperature_rollup WHERE resolution = " + finer + " GROUP BY 1, 3");
+        }
+        
+        if (ok) {
+            execute("COMMIT");
+        } else {
+            std::cerr << "Rollup backfill failed\n";
+            execute("ROLLBACK");
+        }
+    }
+    
+    void createTables() {
+        int version = queryInt("PRAGMA user_version");
+        
+        if (version < 1 && hasColumn("temperature_raw", "timestamp")) {
+            migrateRawToEpoch();
+        }
+        
+        if (version < 4) {
+            migrateToSensors();
+        }
+        
+        createRawTable();
+        createRollupTable();
+        createSensorTable();
+        createAverageTables();
+        
+        if (version < 2) {
+            backfillRollups();
+        }
+        
+        if (version < 4) {
+            execute("INSERT OR IGNORE INTO sensor (id) SELECT DISTINCT sensor_id FROM temperature_rollup");
+        }
+        
+        // Схема 2 -> 3: старый файл без auto_vacuum переводится один раз
+        // полным VACUUM (новым файлам режим задан в open)
+        if (version < 3 && queryInt("PRAGMA auto_vacuum") != 2) {
+            std::cout << "Enabling incremental auto_vacuum (one-time VACUUM)\n";
+            execute("PRAGMA auto_vacuum = INCREMENTAL");
+            execute("VACUUM");
+        }
+        
+        execute("PRAGMA user_version = " + std::to_string(DB_SCHEMA_VERSION));
+    }
+    
+    bool insertSample(const Sample& sample) {
         std::lock_guard<std::mutex> lock(db_mutex);
         
         if (!db) {
@@ -145,280 +760,610 @@ public:
             return false;
         }
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            INSERT INTO temperature_raw (timestamp, temperature, date, hour)
-            VALUES (?, ?, ?, ?)
-        )";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            std::cerr << sqlite3_errmsg(db) << "\n";
-            return false;
+        // Замер и его сводки - одной транзакцией
+        bool success = runStatement(STMT_BEGIN);
+        if (success) {
+            success = insertRawLocked(sample) && upsertRollupsLocked(&sample, 1) &&
+                      runStatement(STMT_COMMIT);
+            if (!success) runStatement(STMT_ROLLBACK);
         }
         
-        sqlite3_bind_text(stmt, 1, record.timestamp.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 2, record.temperature);
-        sqlite3_bind_text(stmt, 3, record.date.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 4, record.hour.c_str(), -1, SQLITE_STATIC);
-        
-        int rc = sqlite3_step(stmt);
-        bool success = (rc == SQLITE_DONE);
-        
         if (success) {
+            noteWrittenLocked(&sample, 1);
             std::cout << "Data inserted\n";
         } else {
             std::cerr << "Failed to insert data\n";
         }
         
-        sqlite3_finalize(stmt);
         return success;
     }
     
-    bool insertHourlyAverage(const std::string& timestamp, double avg_temp, 
-                           double min_temp, double max_temp, int count) {
+    // После коммита: замеры в порядке поступления только двигают
+    // written_through_ms, а более старые (из файла переполнения) меняют
+    // уже отданные диапазоны
+    void noteWrittenLocked(const Sample* samples, size_t count) {
+        int64_t through = written_through_ms.load();
+        int64_t oldest = samples[0].ts_ms, newest = samples[0].ts_ms;
+        for (size_t i = 1; i < count; ++i) {
+            if (samples[i].ts_ms < oldest) oldest = samples[i].ts_ms;
+            if (samples[i].ts_ms > newest) newest = samples[i].ts_ms;
+        }
+        
+        if (oldest < through) ++data_epoch;
+        if (newest > through) written_through_ms = newest;
+        ++write_count;
+    }
+    
+    // Вставка пачки замеров одной транзакцией
+    bool insertSamples(const std::vector<Sample>& samples) {
         std::lock_guard<std::mutex> lock(db_mutex);
         
-        if (!db) return false;
+        if (!db) {
+            std::cerr << "Database not opened for insert\n";
+            return false;
+        }
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            INSERT OR REPLACE INTO temperature_hourly 
-            (timestamp, avg_temperature, min_temperature, max_temperature, sample_count)
-            VALUES (?, ?, ?, ?, ?)
-        )";
+        if (samples.empty()) return true;
         
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        if (!runStatement(STMT_BEGIN)) {
+            std::cerr << sqlite3_errmsg(db) << "\n";
             return false;
         }
         
-        sqlite3_bind_text(stmt, 1, timestamp.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 2, avg_temp);
-        sqlite3_bind_double(stmt, 3, min_temp);
-        sqlite3_bind_double(stmt, 4, max_temp);
-        sqlite3_bind_int(stmt, 5, count);
+        for (const auto& sample : samples) {
+            if (!insertRawLocked(sample)) {
+                std::cerr << "Failed to insert data\n";
+                runStatement(STMT_ROLLBACK);
+                return false;
+            }
+        }
         
-        bool result = (sqlite3_step(stmt) == SQLITE_DONE);
-        sqlite3_finalize(stmt);
+        if (!upsertRollupsLocked(samples.data(), samples.size())) {
+            std::cerr << "Failed to update rollups\n";
+            runStatement(STMT_ROLLBACK);
+            return false;
+        }
         
-        return result;
+        if (!runStatement(STMT_COMMIT)) {
+            std::cerr << sqlite3_errmsg(db) << "\n";
+            runStatement(STMT_ROLLBACK);
+            return false;
+        }
+        
+        noteWrittenLocked(samples.data(), samples.size());
+        std::cout << "Data inserted: " << samples.size() << " records\n";
+        return true;
     }
     
-    bool insertDailyAverage(const std::string& date, double avg_temp,
-                          double min_temp, double max_temp, int count) {
+    // Старый интерфейс со строковыми метками времени
+    bool insertRawData(const TemperatureRecord& record) {
+        return insertSample(sampleFromRecord(record));
+    }
+    
+    bool insertRawBatch(const std::vector<TemperatureRecord>& records) {
+        std::vector<Sample> samples;
+        samples.reserve(records.size());
+        for (const auto& record : records) {
+            samples.push_back(sampleFromRecord(record));
+        }
+        return insertSamples(samples);
+    }
+    
+    bool insertHourlyAverage(const std::string& timestamp, double avg_temp, 
+                           double min_temp, double max_temp, int count, uint32_t sensor_id = 0) {
         std::lock_guard<std::mutex> lock(db_mutex);
         
         if (!db) return false;
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            INSERT OR REPLACE INTO temperature_daily 
-            (date, avg_temperature, min_temperature, max_temperature, sample_count)
-            VALUES (?, ?, ?, ?, ?)
-        )";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return false;
-        }
+        CachedStatement stmt(statements[STMT_INSERT_HOURLY]);
         
-        sqlite3_bind_text(stmt, 1, date.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_double(stmt, 2, avg_temp);
-        sqlite3_bind_double(stmt, 3, min_temp);
-        sqlite3_bind_double(stmt, 4, max_temp);
-        sqlite3_bind_int(stmt, 5, count);
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_text(stmt.get(), 2, timestamp.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt.get(), 3, avg_temp);
+        sqlite3_bind_double(stmt.get(), 4, min_temp);
+        sqlite3_bind_double(stmt.get(), 5, max_temp);
+        sqlite3_bind_int(stmt.get(), 6, count);
         
-        bool result = (sqlite3_step(stmt) == SQLITE_DONE);
-        sqlite3_finalize(stmt);
-        
-        return result;
+        return (sqlite3_step(stmt.get()) == SQLITE_DONE);
     }
     
-    std::vector<Database::TemperatureRecord> getRawData(const std::string& start_time, 
-                                                        const std::string& end_time, 
-                                                        int limit = 1000) {
+    bool insertDailyAverage(const std::string& date, double avg_temp,
+                          double min_temp, double max_temp, int count, uint32_t sensor_id = 0) {
         std::lock_guard<std::mutex> lock(db_mutex);
-        std::vector<TemperatureRecord> results;
         
-        if (!db) return results;
+        if (!db) return false;
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            SELECT timestamp, temperature, date, hour 
-            FROM temperature_raw 
-            WHERE timestamp BETWEEN ? AND ?
-            ORDER BY timestamp DESC
-            LIMIT ?
-        )";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            std::cerr << sqlite3_errmsg(db) << "\n";
-            return results;
-        }
+        CachedStatement stmt(statements[STMT_INSERT_DAILY]);
         
-        sqlite3_bind_text(stmt, 1, start_time.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, end_time.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 3, limit);
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_text(stmt.get(), 2, date.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_double(stmt.get(), 3, avg_temp);
+        sqlite3_bind_double(stmt.get(), 4, min_temp);
+        sqlite3_bind_double(stmt.get(), 5, max_temp);
+        sqlite3_bind_int(stmt.get(), 6, count);
         
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            TemperatureRecord record;
-            record.timestamp = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            record.temperature = sqlite3_column_double(stmt, 1);
-            record.date = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-            record.hour = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-            results.push_back(record);
+        return (sqlite3_step(stmt.get()) == SQLITE_DONE);
+    }
+    
+    // Замеры датчика из [start_ms, end_ms], от новых к старым
+    std::vector<Sample> getSamples(int64_t start_ms, int64_t end_ms, int limit = 1000,
+                                   uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
+        std::vector<Sample> results;
+        
+        if (!reader) return results;
+        
+        CachedStatement stmt(reader.statement(STMT_SELECT_RAW));
+        
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_int64(stmt.get(), 2, start_ms);
+        sqlite3_bind_int64(stmt.get(), 3, end_ms);
+        sqlite3_bind_int(stmt.get(), 4, limit);
+        
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            Sample sample;
+            sample.ts_ms = sqlite3_column_int64(stmt.get(), 0);
+            sample.value = static_cast<float>(sqlite3_column_double(stmt.get(), 1));
+            sample.sensor_id = sensor_id;
+            results.push_back(sample);
         }
         
-        sqlite3_finalize(stmt);
         return results;
     }
     
+    // До limit замеров из [start_ms, end_ms] после cursor (от новых к старым)
+    // с продвижением cursor. Соединение чтения занято только на время
+    // страницы, между страницами его получают другие запросы
+    size_t getSamplesPage(int64_t start_ms, int64_t end_ms, SampleCursor& cursor, size_t limit,
+                          std::vector<Sample>& out, uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
+        out.clear();
+        
+        if (!reader) return 0;
+        
+        CachedStatement stmt(reader.statement(STMT_SELECT_RAW_PAGE));
+        
+        // Первая страница (курсор еще за концом диапазона) - все строки до end_ms
+        bool first = cursor.ts_ms > end_ms;
+        sqlite3_bind_int64(stmt.get(), 1, start_ms);
+        sqlite3_bind_int64(stmt.get(), 2, first ? end_ms : cursor.ts_ms);
+        sqlite3_bind_double(stmt.get(), 3, first ? HUGE_VAL : cursor.temperature);
+        sqlite3_bind_int64(stmt.get(), 4, first ? INT64_MAX : cursor.id);
+        sqlite3_bind_int64(stmt.get(), 5, static_cast<sqlite3_int64>(limit));
+        sqlite3_bind_int64(stmt.get(), 6, sensor_id);
+        
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            cursor.ts_ms = sqlite3_column_int64(stmt.get(), 0);
+            cursor.temperature = sqlite3_column_double(stmt.get(), 1);
+            cursor.id = sqlite3_column_int64(stmt.get(), 2);
+            
+            Sample sample;
+            sample.ts_ms = cursor.ts_ms;
+            sample.value = static_cast<float>(cursor.temperature);
+            sample.sensor_id = sensor_id;
+            out.push_back(sample);
+        }
+        
+        return out.size();
+    }
+    
+    std::vector<Database::TemperatureRecord> getRawData(int64_t start_ms, int64_t end_ms,
+                                                        int limit = 1000) {
+        std::vector<TemperatureRecord> results;
+        for (const auto& sample : getSamples(start_ms, end_ms, limit)) {
+            results.push_back(recordFromMs(sample.ts_ms, sample.value));
+        }
+        return results;
+    }
+    
+    std::vector<Database::TemperatureRecord> getRawData(const std::string& start_time, 
+                                                        const std::string& end_time, 
+                                                        int limit = 1000) {
+        int64_t start_ms, end_ms;
+        if (!parseTimestampMs(start_time, start_ms) || !parseTimestampMs(end_time, end_ms)) {
+            std::cerr << "Invalid time range\n";
+            return std::vector<TemperatureRecord>();
+        }
+        
+        return getRawData(start_ms, end_ms, limit);
+    }
+    
     std::vector<std::pair<std::string, double>> getHourlyAverages(const std::string& start_date,
-                                                                 const std::string& end_date) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+                                                                 const std::string& end_date,
+                                                                 uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
         std::vector<std::pair<std::string, double>> results;
         
-        if (!db) return results;
+        if (!reader) return results;
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            SELECT timestamp, avg_temperature 
-            FROM temperature_hourly 
-            WHERE date(timestamp) BETWEEN ? AND ?
-            ORDER BY timestamp
-        )";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            std::cerr << sqlite3_errmsg(db) << "\n";
-            return results;
-        }
+        CachedStatement stmt(reader.statement(STMT_SELECT_HOURLY));
         
-        sqlite3_bind_text(stmt, 1, start_date.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, end_date.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_text(stmt.get(), 2, start_date.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 3, end_date.c_str(), -1, SQLITE_STATIC);
         
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            std::string timestamp = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            double avg_temp = sqlite3_column_double(stmt, 1);
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            std::string timestamp = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0));
+            double avg_temp = sqlite3_column_double(stmt.get(), 1);
             results.emplace_back(timestamp, avg_temp);
         }
         
-        sqlite3_finalize(stmt);
         return results;
     }
     
     std::vector<std::pair<std::string, double>> getDailyAverages(const std::string& start_date,
-                                                                const std::string& end_date) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+                                                                const std::string& end_date,
+                                                                uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
         std::vector<std::pair<std::string, double>> results;
         
-        if (!db) return results;
+        if (!reader) return results;
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            SELECT date, avg_temperature 
-            FROM temperature_daily 
-            WHERE date BETWEEN ? AND ?
-            ORDER BY date
-        )";
-        
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            std::cerr << sqlite3_errmsg(db) << "\n";
-            return results;
-        }
+        CachedStatement stmt(reader.statement(STMT_SELECT_DAILY));
         
-        sqlite3_bind_text(stmt, 1, start_date.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, end_date.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_text(stmt.get(), 2, start_date.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 3, end_date.c_str(), -1, SQLITE_STATIC);
         
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            std::string date = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            double avg_temp = sqlite3_column_double(stmt, 1);
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            std::string date = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0));
+            double avg_temp = sqlite3_column_double(stmt.get(), 1);
             results.emplace_back(date, avg_temp);
         }
         
-        sqlite3_finalize(stmt);
         return results;
     }
     
-    double getCurrentTemperature() {
-        std::lock_guard<std::mutex> lock(db_mutex);
+    double getCurrentTemperature(uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
         
-        if (!db) return 0.0;
-        
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            SELECT temperature 
-            FROM temperature_raw 
-            ORDER BY timestamp DESC 
-            LIMIT 1
-        )";
+        if (!reader) return 0.0;
         
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return 0.0;
-        }
+        CachedStatement stmt(reader.statement(STMT_SELECT_CURRENT));
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
         
         double result = 0.0;
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            result = sqlite3_column_double(stmt, 0);
+        if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            result = sqlite3_column_double(stmt.get(), 0);
         }
         
-        sqlite3_finalize(stmt);
         return result;
     }
     
-    Statistics getStatistics(const std::string& start_time, const std::string& end_time) {
-        std::lock_guard<std::mutex> lock(db_mutex);
+    // Статистика за [start_ms, end_ms]: середина диапазона берется из самых
+    // крупных целиком попавших в него сводок, края - из более мелких и,
+    // в последнюю очередь, из сырых замеров. За месяц читается несколько
+    // сотен строк вместо миллионов
+    Statistics getStatistics(int64_t start_ms, int64_t end_ms, uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
         Statistics stats;
         
-        if (!db) return stats;
+        if (!reader || end_ms < start_ms) return stats;
+        
+        std::vector<RangePart> parts;
+        planRange(start_ms, end_ms + 1, ROLLUP_DAY, parts);
+        
+        RollupTotals totals;
+        for (const auto& part : parts) {
+            bool raw = part.level == ROLLUP_LEVELS;
+            CachedStatement stmt(reader.statement(raw ? STMT_SELECT_STATISTICS : STMT_SELECT_ROLLUP_STATISTICS));
+            
+            int index = 1;
+            sqlite3_bind_int64(stmt.get(), index++, sensor_id);
+            if (!raw) sqlite3_bind_int64(stmt.get(), index++, rollupWidth(part.level));
+            sqlite3_bind_int64(stmt.get(), index++, part.from_ms);
+            sqlite3_bind_int64(stmt.get(), index++, part.to_ms);
+            
+            if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+                RollupTotals part_totals;
+                part_totals.count = sqlite3_column_int64(stmt.get(), 0);
+                part_totals.sum = sqlite3_column_double(stmt.get(), 1);
+                part_totals.min = sqlite3_column_double(stmt.get(), 2);
+                part_totals.max = sqlite3_column_double(stmt.get(), 3);
+                part_totals.sumsq = sqlite3_column_double(stmt.get(), 4);
+                totals.merge(part_totals);
+            }
+        }
         
-        sqlite3_stmt* stmt;
-        const char* sql = R"(
-            SELECT 
-                AVG(temperature),
-                MIN(temperature),
-                MAX(temperature),
-                COUNT(*)
-            FROM temperature_raw 
-            WHERE timestamp BETWEEN ? AND ?
-        )";
+        stats.avg_temp = totals.average();
+        stats.min_temp = totals.min;
+        stats.max_temp = totals.max;
+        stats.sample_count = static_cast<int>(totals.count);
+        stats.stddev_temp = totals.stddev();
+        return stats;
+    }
+    
+    Statistics getStatistics(const std::string& start_time, const std::string& end_time,
+                             uint32_t sensor_id = 0) {
+        int64_t start_ms, end_ms;
+        if (!parseTimestampMs(start_time, start_ms) || !parseTimestampMs(end_time, end_ms)) {
+            std::cerr << "Invalid time range\n";
+            return Statistics();
+        }
         
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            return stats;
+        return getStatistics(start_ms, end_ms, sensor_id);
+    }
+    
+    // Минутные сводки с началом в [from_ms, to_ms) по возрастанию времени.
+    // Минута целиком лежит в локальном часе и сутках, поэтому по ним можно
+    // восстановить открытые интервалы логгера, не читая temperature_raw
+    std::vector<RollupBucket> getMinuteRollups(int64_t from_ms, int64_t to_ms, uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
+        std::vector<RollupBucket> results;
+        
+        if (!reader) return results;
+        
+        CachedStatement stmt(reader.statement(STMT_SELECT_ROLLUPS));
+        
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_int64(stmt.get(), 2, rollupWidth(ROLLUP_MINUTE));
+        sqlite3_bind_int64(stmt.get(), 3, from_ms);
+        sqlite3_bind_int64(stmt.get(), 4, to_ms);
+        
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            RollupBucket bucket;
+            bucket.start_ms = sqlite3_column_int64(stmt.get(), 0);
+            bucket.totals.count = sqlite3_column_int64(stmt.get(), 1);
+            bucket.totals.sum = sqlite3_column_double(stmt.get(), 2);
+            bucket.totals.min = sqlite3_column_double(stmt.get(), 3);
+            bucket.totals.max = sqlite3_column_double(stmt.get(), 4);
+            bucket.totals.sumsq = sqlite3_column_double(stmt.get(), 5);
+            results.push_back(bucket);
         }
         
-        sqlite3_bind_text(stmt, 1, start_time.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, end_time.c_str(), -1, SQLITE_STATIC);
+        return results;
+    }
+    
+    // Начало последней минуты, за которую у датчика есть замеры. false - замеров нет
+    bool getLastRollupMinute(int64_t& start_ms, uint32_t sensor_id = 0) {
+        ReadLease reader(*this);
         
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            stats.avg_temp = sqlite3_column_double(stmt, 0);
-            stats.min_temp = sqlite3_column_double(stmt, 1);
-            stats.max_temp = sqlite3_column_double(stmt, 2);
-            stats.sample_count = sqlite3_column_int(stmt, 3);
+        if (!reader) return false;
+        
+        CachedStatement stmt(reader.statement(STMT_SELECT_LAST_ROLLUP));
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_int64(stmt.get(), 2, rollupWidth(ROLLUP_MINUTE));
+        
+        if (sqlite3_step(stmt.get()) != SQLITE_ROW || sqlite3_column_type(stmt.get(), 0) == SQLITE_NULL) {
+            return false;
         }
         
-        sqlite3_finalize(stmt);
-        return stats;
+        start_ms = sqlite3_column_int64(stmt.get(), 0);
+        return true;
     }
     
-    bool cleanupOldData(int keep_days = 30) {
+    // Имя датчика (обычно порт). Сам датчик появляется и без этого,
+    // с первым замером
+    bool registerSensor(uint32_t sensor_id, const std::string& name) {
         std::lock_guard<std::mutex> lock(db_mutex);
         
         if (!db) return false;
         
-        std::string sql = R"(
-            DELETE FROM temperature_raw 
-            WHERE date < date('now', '-' || ? || ' days')
-        )";
+        CachedStatement stmt(statements[STMT_NAME_SENSOR]);
         
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
-            return false;
+        sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+        sqlite3_bind_text(stmt.get(), 2, name.c_str(), -1, SQLITE_STATIC);
+        
+        return (sqlite3_step(stmt.get()) == SQLITE_DONE);
+    }
+    
+    std::vector<SensorInfo> getSensors() {
+        ReadLease reader(*this);
+        std::vector<SensorInfo> results;
+        
+        if (!reader) return results;
+        
+        CachedStatement stmt(reader.statement(STMT_SELECT_SENSORS));
+        
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            SensorInfo sensor;
+            sensor.id = static_cast<uint32_t>(sqlite3_column_int64(stmt.get(), 0));
+            const unsigned char* name = sqlite3_column_text(stmt.get(), 1);
+            if (name) sensor.name = reinterpret_cast<const char*>(name);
+            results.push_back(sensor);
         }
         
-        sqlite3_bind_int(stmt, 1, keep_days);
-        bool result = (sqlite3_step(stmt) == SQLITE_DONE);
-        sqlite3_finalize(stmt);
+        return results;
+    }
+    
+    // Граница хранения для keep_days, выровненная по минуте: оставшиеся
+    // минутные сводки совпадают с оставшимися замерами. Часовые и суточные
+    // сводки не удаляются - по ним считается статистика за давние диапазоны
+    static int64_t retentionCutoffMs(int keep_days) {
+        int64_t cutoff = currentTimeMs() - keep_days * MS_PER_DAY;
+        return cutoff - cutoff % MS_PER_MINUTE;
+    }
+    
+    // Одна порция очистки короткой транзакцией: до limit самых старых
+    // замеров раньше cutoff_ms, а когда их не осталось - до limit минутных
+    // сводок. Возвращает число удаленных строк, 0 - удалять больше нечего
+    // (или ошибка, тогда ok = false)
+    size_t deleteOldBatch(int64_t cutoff_ms, size_t limit, bool& ok) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        ok = false;
         
-        return result;
+        if (!db || !runStatement(STMT_BEGIN)) return 0;
+        
+        size_t raw_deleted = 0, rollups_deleted = 0;
+        {
+            CachedStatement stmt(statements[STMT_CLEANUP_RAW]);
+            sqlite3_bind_int64(stmt.get(), 1, cutoff_ms);
+            sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(limit));
+            ok = (sqlite3_step(stmt.get()) == SQLITE_DONE);
+            if (ok) raw_deleted = static_cast<size_t>(sqlite3_changes(db));
+        }
+        
+        // Сводки - только после всех замеров их минут, иначе статистика
+        // на время очистки разойдется с temperature_raw
+        if (ok && raw_deleted < limit) {
+            CachedStatement stmt(statements[STMT_CLEANUP_ROLLUP]);
+            sqlite3_bind_int64(stmt.get(), 1, rollupWidth(ROLLUP_MINUTE));
+            sqlite3_bind_int64(stmt.get(), 2, cutoff_ms);
+            sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(limit - raw_deleted));
+            ok = (sqlite3_step(stmt.get()) == SQLITE_DONE);
+            if (ok) rollups_deleted = static_cast<size_t>(sqlite3_changes(db));
+        }
+        
+        if (!ok || !runStatement(STMT_COMMIT)) {
+            std::cerr << sqlite3_errmsg(db) << "\n";
+            runStatement(STMT_ROLLBACK);
+            ok = false;
+            return 0;
+        }
+        
+        if (raw_deleted > 0 || rollups_deleted > 0) ++data_epoch;
+        return raw_deleted + rollups_deleted;
+    }
+    
+    // Возвращает файлу до pages свободных страниц. Возвращает освобожденные байты
+    int64_t vacuumStep(int pages) {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        
+        if (!db) return 0;
+        
+        int64_t before = queryInt("PRAGMA freelist_count");
+        execute("PRAGMA incremental_vacuum(" + std::to_string(pages) + ")");
+        return (before - queryInt("PRAGMA freelist_count")) * queryInt("PRAGMA page_size");
+    }
+    
+    // Переносит WAL в основной файл и обрезает его. Пока читатели держат
+    // старый снимок, обрезать нельзя (SQLITE_BUSY) - тогда переносится
+    // сколько можно, остальное сделает следующий вызов
+    void checkpoint() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        
+        if (!db) return;
+        
+        int rc = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+            std::cerr << sqlite3_errmsg(db) << "\n";
+        }
+    }
+    
+    // Размер базы в байтах (без WAL)
+    int64_t fileBytes() {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        
+        if (!db) return 0;
+        
+        return static_cast<int64_t>(queryInt("PRAGMA page_count")) * queryInt("PRAGMA page_size");
+    }
+    
+    // Очистка целиком, порциями без пауз. Фоновую очистку с паузами
+    // между порциями делает RetentionWorker
+    bool cleanupOldData(int keep_days = 30) {
+        int64_t cutoff = retentionCutoffMs(keep_days);
+        bool ok = true;
+        while (deleteOldBatch(cutoff, 4096, ok) > 0) {}
+        return ok;
+    }
+    
+    uint64_t dataEpoch() const { return data_epoch.load(); }
+    int64_t writtenThroughMs() const { return written_through_ms.load(); }
+    uint64_t writeCount() const { return write_count.load(); }
+    
+private:
+    bool runStatement(StatementId id) {
+        CachedStatement stmt(statements[id]);
+        return (sqlite3_step(stmt.get()) == SQLITE_DONE);
+    }
+    
+    // Вставка одного замера, db_mutex уже захвачен
+    bool insertRawLocked(const Sample& sample) {
+        CachedStatement stmt(statements[STMT_INSERT_RAW]);
+        
+        sqlite3_bind_int64(stmt.get(), 1, sample.sensor_id);
+        sqlite3_bind_int64(stmt.get(), 2, sample.ts_ms);
+        sqlite3_bind_double(stmt.get(), 3, sample.value);
+        
+        return (sqlite3_step(stmt.get()) == SQLITE_DONE);
+    }
+    
+    // Добавляет замеры к сводкам всех разрешений, db_mutex уже захвачен.
+    // Замеры пачки сначала складываются в памяти: одна запись на корзину.
+    // Заодно отмечает датчики пачки в sensor (по одному разу на датчик)
+    bool upsertRollupsLocked(const Sample* samples, size_t count) {
+        std::map<std::tuple<uint32_t, int64_t, int64_t>, RollupTotals> deltas;
+        for (size_t i = 0; i < count; ++i) {
+            for (int level = ROLLUP_DAY; level < ROLLUP_LEVELS; ++level) {
+                int64_t width = rollupWidth(level);
+                int64_t bucket = samples[i].ts_ms - samples[i].ts_ms % width;
+                deltas[std::make_tuple(samples[i].sensor_id, width, bucket)].add(samples[i].value);
+            }
+        }
+        
+        bool first = true;
+        uint32_t last_sensor = 0;
+        for (const auto& delta : deltas) {
+            uint32_t sensor_id = std::get<0>(delta.first);
+            if (first || sensor_id != last_sensor) {
+                CachedStatement stmt(statements[STMT_INSERT_SENSOR]);
+                sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+                if (sqlite3_step(stmt.get()) != SQLITE_DONE) return false;
+                first = false;
+                last_sensor = sensor_id;
+            }
+            
+            CachedStatement stmt(statements[STMT_UPSERT_ROLLUP]);
+            
+            sqlite3_bind_int64(stmt.get(), 1, sensor_id);
+            sqlite3_bind_int64(stmt.get(), 2, std::get<1>(delta.first));
+            sqlite3_bind_int64(stmt.get(), 3, std::get<2>(delta.first));
+            sqlite3_bind_int64(stmt.get(), 4, delta.second.count);
+            sqlite3_bind_double(stmt.get(), 5, delta.second.sum);
+            sqlite3_bind_double(stmt.get(), 6, delta.second.min);
+            sqlite3_bind_double(stmt.get(), 7, delta.second.max);
+            sqlite3_bind_double(stmt.get(), 8, delta.second.sumsq);
+            
+            if (sqlite3_step(stmt.get()) != SQLITE_DONE) return false;
+        }
+        
+        return true;
+    }
+    
+    // Разбивает [from_ms, to_ms) на целые корзины уровня level посередине
+    // и края, которые уходят на следующий, более мелкий уровень
+    static void planRange(int64_t from_ms, int64_t to_ms, int level, std::vector<RangePart>& parts) {
+        if (from_ms >= to_ms) return;
+        
+        if (level == ROLLUP_LEVELS) {
+            RangePart part = { level, from_ms, to_ms };
+            parts.push_back(part);
+            return;
+        }
+        
+        int64_t width = rollupWidth(level);
+        int64_t first = from_ms % width == 0 ? from_ms : from_ms - from_ms % width + width;
+        int64_t last = to_ms - to_ms % width;
+        
+        if (first >= last) {
+            planRange(from_ms, to_ms, level + 1, parts);
+            return;
+        }
+        
+        planRange(from_ms, first, level + 1, parts);
+        RangePart part = { level, first, last };
+        parts.push_back(part);
+        planRange(last, to_ms, level + 1, parts);
+    }
+    
+    // Запись без разбираемой метки времени получает время приема
+    static Sample sampleFromRecord(const TemperatureRecord& record) {
+        Sample sample;
+        if (!parseTimestampMs(record.timestamp, sample.ts_ms)) {
+            sample.ts_ms = currentTimeMs();
+        }
+        sample.value = static_cast<float>(record.temperature);
+        sample.sensor_id = 0;
+        return sample;
+    }
+    
+    // Строковое представление записи для старого API
+    static TemperatureRecord recordFromMs(int64_t ts, double temperature) {
+        std::string timestamp = formatTimestampMs(ts);
+        return TemperatureRecord(timestamp, temperature, timestamp.substr(0, 10),
+                                 timestamp.substr(0, 13) + ":00:00.000");
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,62 @@
+#ifndef DOWNSAMPLE_HPP
+#define DOWNSAMPLE_HPP
+
+#include "sample.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Прореживание ряда для графика: диапазон [start_ms, end_ms] делится на
+// points / 2 равных по времени корзин ("пикселей"), от каждой остаются
+// минимальный и максимальный замер. Пики и провалы сохраняются, а ответ
+// не длиннее points при любой длине диапазона.
+// Замеры подаются за один проход в любом порядке, память - O(points)
+class MinMaxDownsampler {
+public:
+    MinMaxDownsampler(int64_t start_ms, int64_t end_ms, size_t points)
+        : start_ms(start_ms),
+          span_ms(end_ms >= start_ms ? end_ms - start_ms + 1 : 1),
+          buckets(points / 2 > 0 ? points / 2 : 1) {}
+
+    void add(const Sample& sample) {
+        if (sample.ts_ms < start_ms || sample.ts_ms - start_ms >= span_ms) return;
+
+        Bucket& bucket = buckets[static_cast<size_t>(
+            (sample.ts_ms - start_ms) * static_cast<int64_t>(buckets.size()) / span_ms)];
+
+        if (bucket.empty || sample.value < bucket.min.value) bucket.min = sample;
+        if (bucket.empty || sample.value > bucket.max.value) bucket.max = sample;
+        bucket.empty = false;
+    }
+
+    // Точки по возрастанию времени; в корзине минимум и максимум идут
+    // в том порядке, в каком были замерены
+    void collect(std::vector<Sample>& out) const {
+        out.clear();
+        for (const auto& bucket : buckets) {
+            if (bucket.empty) continue;
+
+            bool min_first = bucket.min.ts_ms <= bucket.max.ts_ms;
+            out.push_back(min_first ? bucket.min : bucket.max);
+            if (bucket.min.ts_ms != bucket.max.ts_ms || bucket.min.value != bucket.max.value) {
+                out.push_back(min_first ? bucket.max : bucket.min);
+            }
+        }
+    }
+
+private:
+    struct Bucket {
+        Sample min;
+        Sample max;
+        bool empty;
+
+        Bucket() : min(), max(), empty(true) {}
+    };
+
+    int64_t start_ms;
+    int64_t span_ms;
+    std::vector<Bucket> buckets;
+};
+
+#endif
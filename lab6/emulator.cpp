@@ -1,3 +1,22 @@
+// Эмулятор датчика температуры
+//     emulator <порт>
+// - замер раз в секунду, как настоящий датчик.
+//
+// Режим нагрузки для проверки сервера под потоком замеров:
+//     emulator <порт> [<порт>...] [--rate=N|max] [--burst=ВКЛ_МС:ВЫКЛ_МС]
+//              [--seed=S] [--corrupt=ДОЛЯ] [--duration=СЕК] [--report=СЕК]
+// Режим включает любой из параметров. Каждый порт - отдельный виртуальный
+// датчик. --rate - строк в секунду на датчик (по умолчанию 1000), max -
+// сколько примет порт. --burst - пачки: ВКЛ_МС шлем, ВЫКЛ_МС
+// молчим. --corrupt - доля строк с неверной контрольной суммой. Значения
+// и испорченные строки зависят только от --seed, меняются лишь метки
+// времени. Раз в --report секунд печатается достигнутая скорость.
+//
+// Сквозная проверка через пару pty:
+//     socat pty,raw,echo=0,link=/tmp/virtual_com1 pty,raw,echo=0,link=/tmp/virtual_com2
+//     ./emulator /tmp/virtual_com1 --rate=5000 --duration=10
+//     ./temp_server /tmp/virtual_com2
+
 #include <iostream>
 #include <thread>
 #include <chrono>
@@ -9,12 +28,22 @@
 #include <csignal>
 #include <vector>
 #include <string>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
 
 #include "my_serial.hpp"
 
 using namespace cplib;
 using namespace std;
 
+#define LOAD_MESSAGES 4096          // заранее готовых строк на датчик, дальше по кругу
+#define LOAD_MAX_CHUNK 512          // строк на датчик за одну запись в порт
+#define LOAD_TICK_MS 1              // шаг расписания отправки
+
 // Глобальный флаг для ctr + C
 atomic<bool> g_running(true);
 
@@ -79,6 +108,222 @@ void emulate_temperature_sensor(SerialPort& port, int interval_ms) {
     }
 }
 
+// Параметры режима нагрузки
+struct LoadOptions {
+    long rate;              // строк в секунду на датчик, 0 - сколько примет порт
+    int burst_on_ms;        // 0 - без пачек
+    int burst_off_ms;
+    uint32_t seed;
+    double corrupt;         // доля строк с неверной контрольной суммой
+    double duration;        // секунд, 0 - до Ctrl+C
+    double report_sec;
+    
+    LoadOptions() : rate(1000), burst_on_ms(0), burst_off_ms(0), seed(1),
+                    corrupt(0.0), duration(0.0), report_sec(1.0) {}
+};
+
+// Виртуальный датчик: свой порт и кольцо готовых строк. Отправка только
+// копирует байты и вписывает текущую метку времени на ее место
+struct VirtualSensor {
+    SerialPort port;
+    string messages;
+    vector<size_t> offsets;         // начало строки i, offsets[LOAD_MESSAGES] - конец
+    vector<size_t> timestamp_pos;   // где в строке i метка времени
+    vector<bool> corrupted;
+    size_t next;
+    uint64_t sent;
+    uint64_t sent_corrupted;
+    
+    VirtualSensor() : next(0), sent(0), sent_corrupted(0) {}
+};
+
+// Метка времени в сообщении всегда этой длины: "2024-01-01 12:00:00.000"
+const size_t TIMESTAMP_LENGTH = 23;
+
+bool parse_load_option(const string& arg, LoadOptions& options) {
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == string::npos) return false;
+    
+    string name = arg.substr(2, eq - 2);
+    string value = arg.substr(eq + 1);
+    char* end = nullptr;
+    if (name == "rate") {
+        if (value == "max") {
+            options.rate = 0;
+            return true;
+        }
+        options.rate = strtol(value.c_str(), &end, 10);
+        return *end == '\0' && options.rate > 0;
+    }
+    if (name == "burst") {
+        return sscanf(value.c_str(), "%d:%d", &options.burst_on_ms, &options.burst_off_ms) == 2 &&
+               options.burst_on_ms > 0 && options.burst_off_ms >= 0;
+    }
+    if (name == "seed") {
+        options.seed = static_cast<uint32_t>(strtoul(value.c_str(), &end, 10));
+        return *end == '\0';
+    }
+    if (name == "corrupt") {
+        options.corrupt = strtod(value.c_str(), &end);
+        return *end == '\0' && options.corrupt >= 0.0 && options.corrupt <= 1.0;
+    }
+    if (name == "duration") {
+        options.duration = strtod(value.c_str(), &end);
+        return *end == '\0' && options.duration >= 0.0;
+    }
+    if (name == "report") {
+        options.report_sec = strtod(value.c_str(), &end);
+        return *end == '\0' && options.report_sec > 0.0;
+    }
+    return false;
+}
+
+// Строки датчика: то же блуждание температуры, что и в обычном режиме,
+// но от своего генератора, поэтому последовательность воспроизводима
+void build_messages(VirtualSensor& sensor, mt19937& rng, double corrupt) {
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    const string placeholder(TIMESTAMP_LENGTH, '0');
+    float temperature = 20.0f;
+    char line[160];
+    
+    sensor.offsets.clear();
+    sensor.timestamp_pos.clear();
+    sensor.corrupted.clear();
+    for (int i = 0; i < LOAD_MESSAGES; ++i) {
+        temperature += (static_cast<int>(rng() % 100) - 50) / 100.0f;
+        temperature = min(max(temperature, -10.0f), 30.0f);
+        
+        bool bad = chance(rng) < corrupt;
+        float checksum = bad ? temperature + 1.0f : temperature;
+        int length = snprintf(line, sizeof(line),
+                              "{\"temperature\": %.2f, \"timestamp\": \"%s\", \"checksum\": %.2f}\r\n",
+                              temperature, placeholder.c_str(), checksum);
+        
+        sensor.offsets.push_back(sensor.messages.size());
+        sensor.timestamp_pos.push_back(sensor.messages.size() + string(line, length).find(placeholder));
+        sensor.corrupted.push_back(bad);
+        sensor.messages.append(line, length);
+    }
+    sensor.offsets.push_back(sensor.messages.size());
+}
+
+// Вся строка в порт, даже если он берет ее по частям
+bool write_all(SerialPort& port, const char* data, size_t size) {
+    while (size > 0) {
+        size_t written = 0;
+        if (port.Write(data, size, &written) != SerialPort::RE_OK) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Сколько миллисекунд с начала приходится на включенную часть пачек
+double active_ms(double elapsed_ms, const LoadOptions& options) {
+    if (options.burst_on_ms <= 0) return elapsed_ms;
+    
+    double period = options.burst_on_ms + options.burst_off_ms;
+    double full = floor(elapsed_ms / period);
+    return full * options.burst_on_ms + min(elapsed_ms - full * period, static_cast<double>(options.burst_on_ms));
+}
+
+bool in_burst_pause(double elapsed_ms, const LoadOptions& options) {
+    if (options.burst_on_ms <= 0) return false;
+    return fmod(elapsed_ms, options.burst_on_ms + options.burst_off_ms) >= options.burst_on_ms;
+}
+
+void report_rate(const char* label, uint64_t lines, uint64_t bytes, uint64_t corrupted, double seconds) {
+    cout << fixed << setprecision(0) << label << lines << " lines in " << setprecision(2) << seconds
+         << " s: " << setprecision(0) << lines / seconds << " lines/s, " << setprecision(1)
+         << bytes / seconds / 1024.0 << " KB/s, " << corrupted << " with bad checksum" << endl;
+}
+
+// Режим нагрузки: строки по расписанию сразу всем датчикам, одна запись
+// в порт на датчик за шаг. Если порт не успевает, запись блокируется и
+// отставание догоняется в следующих шагах - видно по достигнутой скорости
+int run_load(vector<unique_ptr<VirtualSensor>>& sensors, const LoadOptions& options) {
+    mt19937 rng(options.seed);
+    for (auto& sensor : sensors) build_messages(*sensor, rng, options.corrupt);
+    
+    cout << "Load: " << sensors.size() << " sensors, "
+         << (options.rate > 0 ? to_string(options.rate) + " lines/s each" : string("max rate"));
+    if (options.burst_on_ms > 0) cout << ", bursts " << options.burst_on_ms << "/" << options.burst_off_ms << " ms";
+    cout << ", seed " << options.seed << ", corrupt " << options.corrupt << endl;
+    
+    string out;
+    uint64_t total_lines = 0, total_bytes = 0, total_corrupted = 0;
+    uint64_t report_lines = 0, report_bytes = 0, report_corrupted = 0;
+    
+    auto started = chrono::steady_clock::now();
+    auto tick = started;
+    auto last_report = started;
+    bool failed = false;
+    
+    while (g_running && !failed) {
+        double elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        if (options.duration > 0 && elapsed_ms >= options.duration * 1000.0) break;
+        
+        if (options.rate > 0 || in_burst_pause(elapsed_ms, options)) {
+            tick += chrono::milliseconds(LOAD_TICK_MS);
+            this_thread::sleep_until(tick);
+        } else {
+            tick = chrono::steady_clock::now();
+        }
+        
+        // Метка времени одна на шаг: форматировать ее на каждую строку дорого
+        string timestamp = get_current_time();
+        double active = active_ms(elapsed_ms, options);
+        
+        for (auto& sensor : sensors) {
+            uint64_t due = options.rate > 0 ? static_cast<uint64_t>(active * options.rate / 1000.0)
+                                            : sensor->sent + LOAD_MAX_CHUNK;
+            if (options.rate == 0 && in_burst_pause(elapsed_ms, options)) due = sensor->sent;
+            
+            uint64_t count = min<uint64_t>(due > sensor->sent ? due - sensor->sent : 0, LOAD_MAX_CHUNK);
+            if (count == 0) continue;
+            
+            out.clear();
+            for (uint64_t i = 0; i < count; ++i) {
+                size_t index = sensor->next;
+                size_t begin = out.size();
+                out.append(sensor->messages, sensor->offsets[index], sensor->offsets[index + 1] - sensor->offsets[index]);
+                out.replace(begin + sensor->timestamp_pos[index] - sensor->offsets[index], TIMESTAMP_LENGTH, timestamp);
+                if (sensor->corrupted[index]) ++report_corrupted;
+                sensor->next = (index + 1) % LOAD_MESSAGES;
+            }
+            
+            if (!write_all(sensor->port, out.data(), out.size())) {
+                cout << "error\n";
+                failed = true;
+                break;
+            }
+            sensor->sent += count;
+            report_lines += count;
+            report_bytes += out.size();
+        }
+        
+        double since_report = chrono::duration<double>(chrono::steady_clock::now() - last_report).count();
+        if (since_report >= options.report_sec) {
+            report_rate("sent ", report_lines, report_bytes, report_corrupted, since_report);
+            total_lines += report_lines;
+            total_bytes += report_bytes;
+            total_corrupted += report_corrupted;
+            report_lines = report_bytes = report_corrupted = 0;
+            last_report = chrono::steady_clock::now();
+        }
+    }
+    
+    // Итог - только то, что порт действительно отдал
+    for (auto& sensor : sensors) sensor->port.Drain();
+    
+    total_lines += report_lines;
+    total_bytes += report_bytes;
+    total_corrupted += report_corrupted;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    report_rate("total ", total_lines, total_bytes, total_corrupted, seconds);
+    return failed ? 1 : 0;
+}
+
 int main(int argc, char* argv[]) {
     // гспч
     srand(static_cast<unsigned int>(time(nullptr)));
@@ -87,13 +332,43 @@ int main(int argc, char* argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
-    string port_name;
-    if (argc > 1) {
-        port_name = argv[1];
-    } else {
-        return 1; 
+    // Порты и параметры режима нагрузки вперемешку
+    vector<string> port_names;
+    LoadOptions options;
+    bool load = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") == 0) {
+            if (!parse_load_option(arg, options)) {
+                cout << "Unknown option " << arg << "\n";
+                return 1;
+            }
+            load = true;
+        } else {
+            port_names.push_back(arg);
+        }
     }
-
+    if (port_names.empty() || (!load && port_names.size() > 1)) {
+        return 1;
+    }
+    
+    if (load) {
+        vector<unique_ptr<VirtualSensor>> sensors;
+        for (const auto& name : port_names) {
+            unique_ptr<VirtualSensor> sensor(new VirtualSensor());
+            SerialPort::Parameters params(SerialPort::BAUDRATE_115200);
+            params.timeout = 1.0;
+            if (sensor->port.Open(name, params) != SerialPort::RE_OK) {
+                cout << "Error while opening " << name << "\n";
+                return 1;
+            }
+            sensors.push_back(move(sensor));
+        }
+        return run_load(sensors, options);
+    }
+    
+    string port_name = port_names[0];
+    
     try {
         SerialPort port;
         
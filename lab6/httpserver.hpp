@@ -2,15 +2,30 @@
 #define HTTPSERVER_HPP
 
 #include "database.hpp"
+#include "sample_ring.hpp"
+#include "worker_pool.hpp"
+#include "response_cache.hpp"
+#include "aggregator.hpp"
+#include "columnar.hpp"
+#include "downsample.hpp"
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <chrono>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
 #include <ctime>
 #include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <charconv>
+#include <stdexcept>
 
 #if defined (WIN32)
 #   include <winsock2.h>
@@ -19,24 +34,152 @@
 #else
 #   include <sys/socket.h>
 #   include <netinet/in.h>
+#   include <netinet/tcp.h>
 #   include <arpa/inet.h>
 #   include <unistd.h>
+#   include <fcntl.h>
 #   include <poll.h>
+#   include <csignal>
+#   include <cerrno>
 #   define SOCKET int
 #   define INVALID_SOCKET -1
 #   define SOCKET_ERROR -1
 #endif
 
-#define READ_WAIT_MS 50
+#if defined (__linux__)
+#   include <sys/epoll.h>
+#endif
+
+#define LOOP_TICK_MS 1000           // период проверки простаивающих соединений
+#define MAX_EVENTS 256              // событий за один вызов epoll_wait
+#define MAX_CONNECTIONS 4096
+#define MAX_REQUEST_SIZE 16384      // заголовки + тело одного запроса
+#define KEEPALIVE_TIMEOUT_SEC 30
+#define HTTP_WORKER_THREADS 4       // потоки, выполняющие запросы к API
+#define HTTP_QUEUE_DEPTH 256        // запросов в очереди каждого приоритета
+#define ETAG_SETTLE_MS 60000        // диапазон, закончившийся раньше, считается записанным
+#define SSE_CLIENT_BACKLOG 65536    // неотправленных байт у подписчика /api/stream, больше - отключаем
+#define SSE_PENDING_EVENTS 4096     // событий, ждущих раздачи потоком ввода-вывода
+#define SSE_HEARTBEAT_SEC 15        // комментарий в молчащий поток, чтобы найти мертвых клиентов
+#define EXPORT_PAGE_ROWS 4096       // строк потоковой выгрузки /api/raw за одно обращение к базе
+#define EXPORT_LOW_WATER 524288     // следующую страницу читаем, когда в очереди сокета меньше
+#define SERIES_DEFAULT_POINTS 1000  // точек в ответе /api/series без параметра points
+#define SERIES_MAX_POINTS 10000
+#define SERIES_PAGE_ROWS 16384      // строк за одно обращение к базе при прореживании
 
 class HTTPServer {
 private:
     Database* database;
+    const SampleRings* recent_samples;
     SOCKET server_socket;
     std::string server_ip;
     int server_port;
     std::atomic<bool> running;
-    char input_buf[4096];
+    std::thread io_thread;
+    
+    // Запросы выполняются в пуле, поток ввода-вывода только читает и пишет сокеты
+    WorkerPool workers;
+    size_t worker_threads;
+    size_t queue_depth;
+    
+    // Потоковая выгрузка /api/raw?stream=1. Страницы читает пул, пока сокет
+    // успевает их забирать; пока страница читается (fetching), состояние
+    // трогает только пул
+    struct RawExport {
+        uint32_t sensor_id;
+        int64_t start_ms;
+        int64_t end_ms;
+        int64_t remaining;          // сколько строк еще отдать, -1 - без ограничения
+        Database::SampleCursor cursor;
+        bool chunked;               // HTTP/1.1 - chunked, HTTP/1.0 - до закрытия соединения
+        bool first;                 // еще не отдано ни одной строки
+        bool finished;
+        bool fetching;
+        
+        RawExport() : sensor_id(0), start_ms(0), end_ms(0), remaining(-1), chunked(true),
+                      first(true), finished(false), fetching(false) {}
+    };
+    
+    // Состояние одного клиентского соединения (трогает только поток ввода-вывода)
+    struct Connection {
+        SOCKET socket;
+        uint64_t id;                // отличает соединение от нового с тем же сокетом
+        std::string input;          // принятые, но еще не разобранные байты
+        std::string output;         // ответы, которые еще не ушли в сокет
+        size_t output_sent;
+        bool want_write;
+        bool close_after_write;
+        bool peer_closed;
+        bool busy;                  // запрос выполняется в пуле, следующие ждут в input
+        bool streaming;             // подписчик /api/stream, запросов больше не принимаем
+        int64_t stream_sensor;      // события только этого датчика, -1 - всех
+        std::shared_ptr<RawExport> raw_export;  // идет выгрузка, соединение занято (busy)
+        std::chrono::steady_clock::time_point last_active;
+        
+        Connection(SOCKET s, uint64_t id)
+            : socket(s), id(id), output_sent(0), want_write(false), close_after_write(false),
+              peer_closed(false), busy(false), streaming(false), stream_sensor(-1),
+              last_active(std::chrono::steady_clock::now()) {}
+    };
+    
+    std::unordered_map<SOCKET, std::unique_ptr<Connection>> connections;
+    uint64_t next_connection_id;
+    
+    // Готовые ответы от пула, забираются потоком ввода-вывода
+    struct Completion {
+        SOCKET socket;
+        uint64_t connection_id;
+        std::string response;
+        bool partial;               // очередная страница выгрузки, за ней будут еще
+    };
+    
+    std::mutex completions_mutex;
+    std::vector<Completion> completions;
+    
+    // Готовые ответы /api/hourly и /api/daily. closed_through - до какого
+    // момента часы/сутки каждого датчика уже закрыты и записаны логгером:
+    // часы датчиков идут не вместе, закрытие у одного не значит, что
+    // остальные уже записали свои строки. Датчик, о котором логгер еще не
+    // сообщал, закрытых интервалов не имеет
+    ResponseCache response_cache;
+    mutable std::mutex closed_mutex;
+    std::map<uint32_t, int64_t> closed_through[ResponseCache::GROUP_COUNT];
+    
+    // Валидатор ответа для условных запросов. ETag строится из версии
+    // данных, от которых зависит тело, last_modified_ms = 0 - без Last-Modified.
+    // boot_id отличает теги разных запусков сервера
+    struct Validator {
+        std::string etag;
+        int64_t last_modified_ms;
+        bool vary_accept;           // представление зависит от Accept (JSON или колоночное)
+        
+        Validator() : last_modified_ms(0), vary_accept(false) {}
+    };
+    
+    std::string boot_id;
+    
+    // События /api/stream от логгера. Логгер только кладет готовый текст
+    // с номером датчика в очередь, раздает подписчикам поток ввода-вывода
+    std::mutex stream_mutex;
+    std::vector<std::pair<uint32_t, std::string>> stream_events;
+    std::atomic<size_t> stream_clients;
+    
+    struct IoEvent {
+        SOCKET socket;
+        bool readable;
+        bool writable;
+        bool error;
+    };
+    
+    // epoll на Linux, poll/WSAPoll на остальных платформах
+    #if defined (__linux__)
+        int epoll_fd;
+    #endif
+    
+    // Пробуждение цикла из других потоков (готовый ответ, остановка)
+    #if !defined (WIN32)
+        int wake_pipe[2];
+    #endif
     
     // Сетевые функции
     static void initializeNetwork() {
@@ -98,6 +241,27 @@ private:
         return path.empty() ? "/" : path;
     }
     
+    // Декодирование %XX и '+' в параметрах запроса
+    static std::string urlDecode(const std::string& value) {
+        std::string result;
+        result.reserve(value.size());
+        
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] == '+') {
+                result += ' ';
+            } else if (value[i] == '%' && i + 2 < value.size() &&
+                       isxdigit(static_cast<unsigned char>(value[i + 1])) &&
+                       isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+                result += static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                result += value[i];
+            }
+        }
+        
+        return result;
+    }
+    
     static std::map<std::string, std::string> getParamsFromRequest(const std::string& request) {
         std::map<std::string, std::string> params;
         
@@ -118,8 +282,8 @@ private:
             while (std::getline(iss, pair, '&')) {
                 size_t eq_pos = pair.find('=');
                 if (eq_pos != std::string::npos) {
-                    std::string key = pair.substr(0, eq_pos);
-                    std::string value = pair.substr(eq_pos + 1);
+                    std::string key = urlDecode(pair.substr(0, eq_pos));
+                    std::string value = urlDecode(pair.substr(eq_pos + 1));
                     params[key] = value;
                 }
             }
@@ -128,14 +292,237 @@ private:
         return params;
     }
     
+    // Номер датчика из параметра sensor, без него - датчик 0.
+    // false - значение не число
+    static bool sensorParam(const std::map<std::string, std::string>& params, uint32_t& sensor_id) {
+        sensor_id = 0;
+        auto it = params.find("sensor");
+        if (it == params.end()) return true;
+        
+        const std::string& value = it->second;
+        std::from_chars_result result = std::from_chars(value.data(), value.data() + value.size(), sensor_id);
+        return result.ec == std::errc() && result.ptr == value.data() + value.size();
+    }
+    
+    // Кольцо последних замеров датчика, nullptr - кольца нет
+    const SampleRing* recentFor(uint32_t sensor_id) const {
+        return recent_samples ? recent_samples->find(sensor_id) : nullptr;
+    }
+    
+    // Ключ кэша: путь и только значимые параметры, в одном порядке
+    static bool cacheKey(const std::string& path, const std::map<std::string, std::string>& params,
+                         std::string& key, ResponseCache::Group& group) {
+        if (path == "/api/hourly") {
+            group = ResponseCache::GROUP_HOURLY;
+        } else if (path == "/api/daily") {
+            group = ResponseCache::GROUP_DAILY;
+        } else {
+            return false;
+        }
+        
+        auto start_it = params.find("start");
+        auto end_it = params.find("end");
+        uint32_t sensor_id;
+        if (start_it == params.end() || end_it == params.end() || !sensorParam(params, sensor_id)) return false;
+        
+        key = path + "?start=" + start_it->second + "&end=" + end_it->second +
+              "&sensor=" + std::to_string(sensor_id);
+        return true;
+    }
+    
+    int64_t closedThrough(ResponseCache::Group group, uint32_t sensor_id) const {
+        std::lock_guard<std::mutex> lock(closed_mutex);
+        auto it = closed_through[group].find(sensor_id);
+        return it != closed_through[group].end() ? it->second : 0;
+    }
+    
+    // Все сутки диапазона (по end включительно) у датчика уже закрыты - ответ не изменится
+    bool coversClosedBuckets(ResponseCache::Group group, uint32_t sensor_id, const std::string& end_date) const {
+        int64_t end_ms;
+        if (!parseTimestampMs(end_date, end_ms)) return false;
+        
+        int64_t day_start = localDayFloorMs(end_ms);
+        int64_t range_end = localDayFloorMs(day_start + MS_PER_DAY + MS_PER_DAY / 2);
+        return range_end <= closedThrough(group, sensor_id);
+    }
+    
+    // Средние за часы или сутки: из кэша или из базы с сохранением в кэш
+    std::string averagesBody(const std::string& path, const std::map<std::string, std::string>& params) {
+        uint32_t sensor_id;
+        if (!sensorParam(params, sensor_id)) {
+            return "{\"error\": \"Invalid sensor\"}";
+        }
+        
+        std::string key;
+        ResponseCache::Group group;
+        if (!cacheKey(path, params, key, group)) {
+            return "{\"error\": \"Missing start or end parameters\"}";
+        }
+        
+        ResponseCache::Body cached = response_cache.find(key);
+        if (cached) return *cached;
+        
+        const std::string& start = params.find("start")->second;
+        const std::string& end = params.find("end")->second;
+        uint64_t generation = response_cache.generation(group);
+        bool immutable = coversClosedBuckets(group, sensor_id, end);
+        
+        bool hourly = group == ResponseCache::GROUP_HOURLY;
+        auto averages = hourly ? database->getHourlyAverages(start, end, sensor_id)
+                               : database->getDailyAverages(start, end, sensor_id);
+        
+        std::ostringstream response;
+        response << "[";
+        for (size_t i = 0; i < averages.size(); ++i) {
+            response << (hourly ? "{\"timestamp\": \"" : "{\"date\": \"") << averages[i].first << "\", ";
+            response << "\"temperature\": " << std::fixed << std::setprecision(2) << averages[i].second << "}";
+            if (i < averages.size() - 1) response << ",";
+        }
+        response << "]";
+        
+        ResponseCache::Body body = std::make_shared<const std::string>(response.str());
+        response_cache.store(key, group, generation, immutable, body);
+        return *body;
+    }
+    
+    // Замеры датчика для /api/raw. Недавний диапазон отдаем из кольца, более
+    // старую историю - из базы. false - нет start или end
+    bool rawSamples(const std::map<std::string, std::string>& params, std::vector<Sample>& samples) {
+        auto start_it = params.find("start");
+        auto end_it = params.find("end");
+        auto limit_it = params.find("limit");
+        
+        if (start_it == params.end() || end_it == params.end()) return false;
+        
+        uint32_t sensor_id;
+        if (!sensorParam(params, sensor_id)) throw std::invalid_argument("sensor");
+        const SampleRing* recent = recentFor(sensor_id);
+        
+        int limit = 1000;
+        if (limit_it != params.end()) {
+            limit = std::stoi(limit_it->second);
+        }
+        
+        int64_t start_ms, end_ms;
+        if (!parseTimestampMs(start_it->second, start_ms) || !parseTimestampMs(end_it->second, end_ms)) {
+            std::cerr << "Invalid time range\n";
+        } else if (!recent || limit <= 0 || !recent->collect(start_ms, end_ms, limit, samples)) {
+            samples = database->getSamples(start_ms, end_ms, limit, sensor_id);
+        }
+        
+        return true;
+    }
+    
+    // Ряд для графика /api/series: не больше points точек (минимум и максимум
+    // по корзинам) за один проход по диапазону. Диапазон целиком в кольце
+    // берем оттуда, иначе читаем базу страницами, между которыми она
+    // свободна для записи. false - нет start или end
+    bool seriesSamples(const std::map<std::string, std::string>& params, std::vector<Sample>& samples) {
+        auto start_it = params.find("start");
+        auto end_it = params.find("end");
+        auto points_it = params.find("points");
+        
+        samples.clear();
+        if (start_it == params.end() || end_it == params.end()) return false;
+        
+        uint32_t sensor_id;
+        if (!sensorParam(params, sensor_id)) throw std::invalid_argument("sensor");
+        const SampleRing* recent = recentFor(sensor_id);
+        
+        int points = SERIES_DEFAULT_POINTS;
+        if (points_it != params.end()) {
+            points = std::stoi(points_it->second);
+        }
+        if (points < 2) points = 2;
+        if (points > SERIES_MAX_POINTS) points = SERIES_MAX_POINTS;
+        
+        int64_t start_ms, end_ms;
+        if (!parseTimestampMs(start_it->second, start_ms) || !parseTimestampMs(end_it->second, end_ms)) {
+            std::cerr << "Invalid time range\n";
+            return true;
+        }
+        
+        MinMaxDownsampler downsampler(start_ms, end_ms, static_cast<size_t>(points));
+        std::vector<Sample> page;
+        
+        // Без ограничения по числу: collect вернет true, только если нашел начало диапазона
+        if (recent && recent->collect(start_ms, end_ms, SIZE_MAX, page)) {
+            for (const auto& sample : page) downsampler.add(sample);
+        } else {
+            Database::SampleCursor cursor;
+            while (database->getSamplesPage(start_ms, end_ms, cursor, SERIES_PAGE_ROWS, page, sensor_id) > 0) {
+                for (const auto& sample : page) downsampler.add(sample);
+                if (page.size() < SERIES_PAGE_ROWS) break;
+            }
+        }
+        
+        downsampler.collect(samples);
+        return true;
+    }
+    
+    // Замеры массивом JSON, как их отдают /api/raw и /api/series.
+    // Строковые метки времени формируем только здесь, при выдаче
+    static void writeSamplesJson(std::ostringstream& response, const std::vector<Sample>& samples) {
+        response << "[";
+        for (size_t i = 0; i < samples.size(); ++i) {
+            response << "{\"timestamp\": \"" << formatTimestampMs(samples[i].ts_ms) << "\", ";
+            response << "\"temperature\": " << std::fixed << std::setprecision(2) << samples[i].value << "}";
+            if (i < samples.size() - 1) response << ",";
+        }
+        response << "]";
+    }
+    
+    // Строка для JSON: кавычки, обратная косая черта и управляющие символы
+    static std::string jsonEscape(const std::string& value) {
+        std::string result;
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                result += code;
+            } else {
+                result += c;
+            }
+        }
+        return result;
+    }
+    
+    // Клиент просит двоичный колоночный формат вместо JSON
+    static bool acceptsColumnar(const std::string& request) {
+        std::string accept;
+        return findHeader(request, "accept", accept) &&
+               accept.find(COLUMNAR_CONTENT_TYPE) != std::string::npos;
+    }
+    
     // Обработка API запросов
     std::string handleAPI(const std::string& path, const std::map<std::string, std::string>& params) {
         std::ostringstream response;
         
-        if (path == "/api/current") {
-            double current_temp = database->getCurrentTemperature();
+        uint32_t sensor_id;
+        if (!sensorParam(params, sensor_id)) {
+            response << "{\"error\": \"Invalid sensor\"}";
+            
+        } else if (path == "/api/current") {
+            // Последний замер берем из кольца, база - только если оно пустое
+            const SampleRing* recent = recentFor(sensor_id);
+            Sample latest;
+            double current_temp = (recent && recent->latest(latest))
+                ? latest.value
+                : database->getCurrentTemperature(sensor_id);
             response << "{\"temperature\": " << std::fixed << std::setprecision(2) << current_temp << "}";
             
+        } else if (path == "/api/sensors") {
+            std::vector<Database::SensorInfo> sensors = database->getSensors();
+            response << "[";
+            for (size_t i = 0; i < sensors.size(); ++i) {
+                response << "{\"id\": " << sensors[i].id << ", \"name\": \"" << jsonEscape(sensors[i].name) << "\"}";
+                if (i < sensors.size() - 1) response << ",";
+            }
+            response << "]";
+            
         } else if (path == "/api/statistics") {
             auto start_it = params.find("start");
             auto end_it = params.find("end");
@@ -143,111 +530,937 @@ private:
             if (start_it == params.end() || end_it == params.end()) {
                 response << "{\"error\": \"Missing start or end parameters\"}";
             } else {
-                Database::Statistics stats = database->getStatistics(start_it->second, end_it->second);
+                Database::Statistics stats = database->getStatistics(start_it->second, end_it->second, sensor_id);
                 response << "{";
                 response << "\"average\": " << std::fixed << std::setprecision(2) << stats.avg_temp << ",";
                 response << "\"min\": " << stats.min_temp << ",";
                 response << "\"max\": " << stats.max_temp << ",";
+                response << "\"stddev\": " << stats.stddev_temp << ",";
                 response << "\"samples\": " << stats.sample_count;
                 response << "}";
             }
             
         } else if (path == "/api/raw") {
-            auto start_it = params.find("start");
-            auto end_it = params.find("end");
-            auto limit_it = params.find("limit");
+            std::vector<Sample> samples;
             
-            if (start_it == params.end() || end_it == params.end()) {
+            if (!rawSamples(params, samples)) {
                 response << "{\"error\": \"Missing start or end parameters\"}";
             } else {
-                int limit = 1000;
-                if (limit_it != params.end()) {
-                    limit = std::stoi(limit_it->second);
-                }
-                
-                auto records = database->getRawData(start_it->second, end_it->second, limit);
-                
-                response << "[";
-                for (size_t i = 0; i < records.size(); ++i) {
-                    response << "{\"timestamp\": \"" << records[i].timestamp << "\", ";
-                    response << "\"temperature\": " << std::fixed << std::setprecision(2) << records[i].temperature << "}";
-                    if (i < records.size() - 1) response << ",";
-                }
-                response << "]";
+                writeSamplesJson(response, samples);
             }
             
-        } else if (path == "/api/hourly") {
-            auto start_it = params.find("start");
-            auto end_it = params.find("end");
+        } else if (path == "/api/series") {
+            std::vector<Sample> samples;
             
-            if (start_it == params.end() || end_it == params.end()) {
+            if (!seriesSamples(params, samples)) {
                 response << "{\"error\": \"Missing start or end parameters\"}";
             } else {
-                auto averages = database->getHourlyAverages(start_it->second, end_it->second);
+                writeSamplesJson(response, samples);
+            }
+            
+        } else if (path == "/api/hourly" || path == "/api/daily") {
+            response << averagesBody(path, params);
+            
+        } else if (path == "/") {
+            response << "{\"status\": \"running\"}";
+            
+        } else {
+            response << "{\"error\": \"Unknown url\"}";
+        }
+        
+        return response.str();
+    }
+    
+    // Запрос, начинающийся с offset, целиком: заголовки до пустой строки и
+    // тело по Content-Length. Возвращает его длину или 0, если он еще не дочитан
+    static size_t completeRequestLength(const std::string& input, size_t offset, bool& too_large) {
+        too_large = false;
+        
+        size_t header_end = input.find("\r\n\r\n", offset);
+        if (header_end == std::string::npos) {
+            too_large = input.size() - offset > MAX_REQUEST_SIZE;
+            return 0;
+        }
+        size_t header_length = header_end + 4 - offset;
+        
+        size_t body_length = 0;
+        std::string value;
+        if (findHeader(input.substr(offset, header_length), "content-length", value)) {
+            body_length = static_cast<size_t>(strtoul(value.c_str(), nullptr, 10));
+        }
+        
+        if (header_length + body_length > MAX_REQUEST_SIZE) {
+            too_large = true;
+            return 0;
+        }
+        
+        return input.size() - offset >= header_length + body_length ? header_length + body_length : 0;
+    }
+    
+    // Значение заголовка name (в нижнем регистре) без пробелов по краям
+    static bool findHeader(const std::string& request, const char* name, std::string& value) {
+        size_t name_len = strlen(name);
+        size_t line_start = request.find("\r\n");
+        
+        while (line_start != std::string::npos) {
+            line_start += 2;
+            size_t line_end = request.find("\r\n", line_start);
+            if (line_end == std::string::npos || line_end == line_start) return false;
+            
+            size_t colon = request.find(':', line_start);
+            if (colon < line_end && colon - line_start == name_len) {
+                bool match = true;
+                for (size_t i = 0; i < name_len && match; ++i) {
+                    match = tolower(static_cast<unsigned char>(request[line_start + i])) == name[i];
+                }
                 
-                response << "[";
-                for (size_t i = 0; i < averages.size(); ++i) {
-                    response << "{\"timestamp\": \"" << averages[i].first << "\", ";
-                    response << "\"temperature\": " << std::fixed << std::setprecision(2) << averages[i].second << "}";
-                    if (i < averages.size() - 1) response << ",";
+                if (match) {
+                    size_t begin = request.find_first_not_of(" \t", colon + 1);
+                    size_t end = request.find_last_not_of(" \t", line_end - 1);
+                    value = (begin == std::string::npos || begin > end)
+                        ? std::string() : request.substr(begin, end - begin + 1);
+                    return true;
                 }
-                response << "]";
             }
             
-        } else if (path == "/api/daily") {
-            auto start_it = params.find("start");
+            line_start = line_end;
+        }
+        
+        return false;
+    }
+    
+    static bool isHttp11(const std::string& request) {
+        size_t line_end = request.find("\r\n");
+        return line_end != std::string::npos && line_end >= 8 &&
+               request.compare(line_end - 8, 8, "HTTP/1.1") == 0;
+    }
+    
+    // HTTP/1.1 держит соединение по умолчанию, HTTP/1.0 - только по просьбе клиента
+    static bool wantsKeepAlive(const std::string& request) {
+        bool http11 = isHttp11(request);
+        
+        std::string connection;
+        if (findHeader(request, "connection", connection)) {
+            for (auto& c : connection) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            if (connection == "close") return false;
+            if (connection == "keep-alive") return true;
+        }
+        
+        return http11;
+    }
+    
+    // Версия данных для ответа на path. false - ответ не кэшируется клиентом
+    bool responseValidator(const std::string& path, const std::map<std::string, std::string>& params,
+                           Validator& validator) {
+        uint32_t sensor_id;
+        if (!sensorParam(params, sensor_id)) return false;
+        
+        std::ostringstream etag;
+        etag << "\"" << boot_id << "-";
+        
+        // Тег зависит от датчика: у каждого свое кольцо и свои замеры
+        const SampleRing* recent = recentFor(sensor_id);
+        Sample latest = { 0, 0.0f, 0 };
+        bool have_latest = recent && recent->latest(latest);
+        
+        if (path == "/api/hourly" || path == "/api/daily") {
+            // Меняется только при закрытии часа/суток
+            ResponseCache::Group group = path == "/api/hourly" ? ResponseCache::GROUP_HOURLY
+                                                               : ResponseCache::GROUP_DAILY;
+            etag << "g" << sensor_id << "." << response_cache.generation(group);
+            validator.last_modified_ms = closedThrough(group, sensor_id);
+        
+        } else if (path == "/api/current") {
+            if (!have_latest) return false;
+            etag << "s" << sensor_id << "." << recent->count();
+            validator.last_modified_ms = latest.ts_ms;
+        
+        } else if (path == "/api/raw" || path == "/api/series" || path == "/api/statistics") {
             auto end_it = params.find("end");
+            int64_t end_ms;
+            if (end_it == params.end() || !parseTimestampMs(end_it->second, end_ms)) return false;
             
-            if (start_it == params.end() || end_it == params.end()) {
-                response << "{\"error\": \"Missing start or end parameters\"}";
+            // Прошлый диапазон меняется только при очистке базы и дозаписи
+            // старых замеров (dataEpoch), текущий - с каждым замером. Диапазон,
+            // замеры которого еще в очереди записи, прошлым не считается
+            int64_t horizon = have_latest ? latest.ts_ms : currentTimeMs();
+            if (end_ms + ETAG_SETTLE_MS < horizon && end_ms < database->writtenThroughMs()) {
+                etag << "h" << sensor_id << "." << database->dataEpoch();
             } else {
-                auto averages = database->getDailyAverages(start_it->second, end_it->second);
+                etag << "w" << sensor_id << "." << (recent ? recent->count() : 0)
+                     << "." << database->writeCount() << "." << database->dataEpoch();
+            }
+        
+        } else {
+            return false;
+        }
+        
+        etag << "\"";
+        validator.etag = etag.str();
+        return true;
+    }
+    
+    // If-None-Match (список тегов или *), а если его нет - If-Modified-Since
+    static bool notModified(const std::string& request, const Validator& validator) {
+        std::string value;
+        if (findHeader(request, "if-none-match", value)) {
+            size_t pos = 0;
+            while (pos < value.size()) {
+                size_t comma = value.find(',', pos);
+                if (comma == std::string::npos) comma = value.size();
                 
-                response << "[";
-                for (size_t i = 0; i < averages.size(); ++i) {
-                    response << "{\"date\": \"" << averages[i].first << "\", ";
-                    response << "\"temperature\": " << std::fixed << std::setprecision(2) << averages[i].second << "}";
-                    if (i < averages.size() - 1) response << ",";
+                size_t begin = value.find_first_not_of(" \t", pos);
+                size_t end = value.find_last_not_of(" \t", comma - 1);
+                if (begin != std::string::npos && begin < comma) {
+                    std::string tag = value.substr(begin, end - begin + 1);
+                    if (tag.compare(0, 2, "W/") == 0) tag.erase(0, 2);
+                    if (tag == "*" || tag == validator.etag) return true;
                 }
-                response << "]";
+                pos = comma + 1;
             }
-            
-        } else if (path == "/") {
-            response << "{\"status\": \"running\"}";
-            
-        } else {
-            response << "{\"error\": \"Unknown url\"}";
+            return false;
+        }
+        
+        int64_t since;
+        if (validator.last_modified_ms > 0 && findHeader(request, "if-modified-since", value) &&
+            parseHttpDate(value, since)) {
+            // В пределах текущей секунды данные еще могут поменяться
+            int64_t modified = validator.last_modified_ms / 1000;
+            return modified <= since && modified < currentTimeMs() / 1000;
+        }
+        
+        return false;
+    }
+    
+    static std::string notModifiedResponse(const Validator& validator, bool keep_alive) {
+        std::ostringstream response;
+        response << "HTTP/1.1 304 Not Modified\r\n"
+                 << "ETag: " << validator.etag << "\r\n";
+        if (validator.last_modified_ms > 0) {
+            response << "Last-Modified: " << formatHttpDate(validator.last_modified_ms) << "\r\n";
         }
+        response << "Access-Control-Allow-Origin: *\r\n"
+                 << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n"
+                 << "\r\n";
         
         return response.str();
     }
     
-    std::string handleRequest(const std::string& request) {
+    std::string handleRequest(const std::string& request, bool keep_alive, const Validator& validator) {
         std::string path = getPathFromRequest(request);
         auto params = getParamsFromRequest(request);
         
-        std::string content_type = "application/json";
-        std::string response_body = handleAPI(path, params);
+        std::string response_body;
+        const char* content_type = "application/json";
+        try {
+            std::vector<Sample> samples;
+            bool columnar = acceptsColumnar(request) &&
+                            ((path == "/api/raw" && rawSamples(params, samples)) ||
+                             (path == "/api/series" && seriesSamples(params, samples)));
+            if (columnar) {
+                response_body = encodeColumnar(samples);
+                content_type = COLUMNAR_CONTENT_TYPE;
+            } else {
+                response_body = handleAPI(path, params);
+            }
+        } catch (const std::exception&) {
+            // Например, нечисловой limit - не роняем поток сервера
+            response_body = "{\"error\": \"Bad request\"}";
+            content_type = "application/json";
+        }
         
+        return responseHeaders(response_body.length(), keep_alive, validator, content_type) + response_body;
+    }
+    
+    static std::string responseHeaders(size_t content_length, bool keep_alive, const Validator& validator,
+                                       const char* content_type = "application/json") {
         std::ostringstream response;
         response << "HTTP/1.1 200 OK\r\n"
                  << "Content-Type: " << content_type << "\r\n"
-                 << "Content-Length: " << response_body.length() << "\r\n"
-                 << "Access-Control-Allow-Origin: *\r\n"
-                 << "Connection: close\r\n"
-                 << "\r\n"
-                 << response_body;
+                 << "Content-Length: " << content_length << "\r\n";
+        if (!validator.etag.empty()) {
+            // no-cache: клиент хранит ответ, но каждый раз сверяет тег с сервером
+            response << "ETag: " << validator.etag << "\r\n"
+                     << "Cache-Control: no-cache\r\n";
+        }
+        if (validator.last_modified_ms > 0) {
+            response << "Last-Modified: " << formatHttpDate(validator.last_modified_ms) << "\r\n";
+        }
+        if (validator.vary_accept) {
+            response << "Vary: Accept\r\n";
+        }
+        response << "Access-Control-Allow-Origin: *\r\n"
+                 << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n"
+                 << "\r\n";
         
         return response.str();
     }
     
+    static bool setNonBlocking(SOCKET sock) {
+        #if defined (WIN32)
+            u_long mode = 1;
+            return ioctlsocket(sock, FIONBIO, &mode) == 0;
+        #else
+            int flags = fcntl(sock, F_GETFL, 0);
+            return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+        #endif
+    }
+    
+    static bool wouldBlock(int error) {
+        #if defined (WIN32)
+            return error == WSAEWOULDBLOCK;
+        #else
+            return error == EAGAIN || error == EWOULDBLOCK;
+        #endif
+    }
+    
+    // Регистрация сокета в epoll (на остальных платформах список для poll
+    // собирается заново на каждой итерации). want_read = false - клиент закрыл
+    // свою сторону, иначе EPOLLIN срабатывает на каждом круге
+    void watchSocket(SOCKET sock, bool add, bool want_write, bool want_read = true) {
+        #if defined (__linux__)
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = want_read ? static_cast<uint32_t>(EPOLLIN) : 0u;
+            if (want_write) ev.events |= EPOLLOUT;
+            ev.data.fd = sock;
+            epoll_ctl(epoll_fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, sock, &ev);
+        #else
+            (void)sock;
+            (void)add;
+            (void)want_write;
+            (void)want_read;
+        #endif
+    }
+    
+    void wakeLoop() {
+        #if !defined (WIN32)
+            char byte = 1;
+            if (wake_pipe[1] != -1 && write(wake_pipe[1], &byte, 1) < 0) {
+                // Канал переполнен - цикл и так проснется
+            }
+        #endif
+    }
+    
+    // Ждем готовности сокетов не дольше LOOP_TICK_MS
+    void waitEvents(std::vector<IoEvent>& events) {
+        events.clear();
+        
+        #if defined (__linux__)
+            struct epoll_event ready[MAX_EVENTS];
+            int n = epoll_wait(epoll_fd, ready, MAX_EVENTS, LOOP_TICK_MS);
+            for (int i = 0; i < n; ++i) {
+                IoEvent ev;
+                ev.socket = ready[i].data.fd;
+                ev.readable = (ready[i].events & (EPOLLIN | EPOLLHUP)) != 0;
+                ev.writable = (ready[i].events & EPOLLOUT) != 0;
+                ev.error = (ready[i].events & EPOLLERR) != 0;
+                events.push_back(ev);
+            }
+        #else
+            std::vector<struct pollfd> fds;
+            fds.reserve(connections.size() + 2);
+            
+            struct pollfd pfd;
+            memset(&pfd, 0, sizeof(pfd));
+            pfd.fd = server_socket;
+            pfd.events = POLLIN;
+            fds.push_back(pfd);
+            
+            #if !defined (WIN32)
+                pfd.fd = wake_pipe[0];
+                fds.push_back(pfd);
+            #endif
+            
+            for (const auto& item : connections) {
+                pfd.fd = item.first;
+                pfd.events = (item.second->peer_closed ? 0 : POLLIN) |
+                             (item.second->want_write ? POLLOUT : 0);
+                fds.push_back(pfd);
+            }
+            
+            #if defined (WIN32)
+                // Канала пробуждения нет: пока запросы в пуле или есть подписчики,
+                // проверяем ответы и события чаще
+                bool in_flight = stream_clients.load() > 0;
+                for (const auto& item : connections) in_flight = in_flight || item.second->busy;
+                int n = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), in_flight ? 1 : LOOP_TICK_MS);
+            #else
+                int n = poll(fds.data(), fds.size(), LOOP_TICK_MS);
+            #endif
+            
+            for (size_t i = 0; n > 0 && i < fds.size(); ++i) {
+                if (fds[i].revents == 0) continue;
+                IoEvent ev;
+                ev.socket = fds[i].fd;
+                ev.readable = (fds[i].revents & (POLLIN | POLLHUP)) != 0;
+                ev.writable = (fds[i].revents & POLLOUT) != 0;
+                ev.error = (fds[i].revents & (POLLERR | POLLNVAL)) != 0;
+                events.push_back(ev);
+            }
+        #endif
+    }
+    
+    void acceptClients() {
+        for (;;) {
+            SOCKET client_socket = accept(server_socket, NULL, NULL);
+            if (client_socket == INVALID_SOCKET) {
+                int error = getErrorCode();
+                if (!wouldBlock(error)) {
+                    std::cerr << "Error: " << error << std::endl;
+                }
+                return;
+            }
+            
+            if (connections.size() >= MAX_CONNECTIONS || !setNonBlocking(client_socket)) {
+                closeSocket(client_socket);
+                continue;
+            }
+            
+            int opt = 1;
+            setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&opt, sizeof(opt));
+            
+            connections[client_socket].reset(new Connection(client_socket, next_connection_id++));
+            watchSocket(client_socket, true, false);
+        }
+    }
+    
+    void closeConnection(SOCKET sock) {
+        auto it = connections.find(sock);
+        if (it != connections.end() && it->second->streaming) --stream_clients;
+        
+        #if defined (__linux__)
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+        #endif
+        closeSocket(sock);
+        connections.erase(sock);
+    }
+    
+    // Быстрые запросы не ждут за тяжелыми выборками по диапазону
+    static WorkerPool::Priority requestPriority(const std::string& request) {
+        std::string path = getPathFromRequest(request);
+        return (path == "/api/current" || path == "/") ? WorkerPool::PRIORITY_FAST
+                                                       : WorkerPool::PRIORITY_SLOW;
+    }
+    
+    // Отдаем запрос в пул. Если очередь полна, сразу отвечаем 503.
+    // Ответ 304 и ответ из кэша отправляем сразу, без пула. Валидатор берем
+    // до выполнения запроса: тело может оказаться только новее тега
+    void dispatchRequest(Connection& conn, const std::string& request, bool keep_alive) {
+        std::string path = getPathFromRequest(request);
+        auto params = getParamsFromRequest(request);
+        
+        if (path == "/api/stream") {
+            startStream(conn, params);
+            return;
+        }
+        
+        Validator validator;
+        bool valid = responseValidator(path, params, validator);
+        
+        // У двоичного представления свой тег
+        if (path == "/api/raw" || path == "/api/series") {
+            validator.vary_accept = true;
+            if (valid && acceptsColumnar(request)) validator.etag.insert(validator.etag.size() - 1, "-c");
+        }
+        
+        if (valid && notModified(request, validator)) {
+            conn.output += notModifiedResponse(validator, keep_alive);
+            return;
+        }
+        
+        if (path == "/api/raw" && params.count("stream") && params.find("stream")->second == "1" &&
+            startExport(conn, params, isHttp11(request), keep_alive)) {
+            return;
+        }
+        
+        std::string key;
+        ResponseCache::Group group;
+        if (cacheKey(path, params, key, group)) {
+            ResponseCache::Body cached = response_cache.find(key);
+            if (cached) {
+                conn.output += responseHeaders(cached->length(), keep_alive, validator);
+                conn.output += *cached;
+                return;
+            }
+        }
+        
+        SOCKET sock = conn.socket;
+        uint64_t id = conn.id;
+        
+        bool queued = workers.submit(requestPriority(request), [this, sock, id, request, keep_alive, validator]() {
+            Completion done;
+            done.socket = sock;
+            done.connection_id = id;
+            done.response = handleRequest(request, keep_alive, validator);
+            done.partial = false;
+            {
+                std::lock_guard<std::mutex> lock(completions_mutex);
+                completions.push_back(std::move(done));
+            }
+            wakeLoop();
+        });
+        
+        if (queued) {
+            conn.busy = true;
+        } else {
+            conn.output += "HTTP/1.1 503 Service Unavailable\r\n"
+                           "Content-Length: 0\r\n"
+                           "Retry-After: 1\r\n";
+            conn.output += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        }
+    }
+    
+    static std::string exportChunk(const std::string& data, bool chunked) {
+        if (!chunked || data.empty()) return data;
+        
+        std::ostringstream chunk;
+        chunk << std::hex << data.size() << "\r\n" << data << "\r\n";
+        return chunk.str();
+    }
+    
+    // Очередная страница выгрузки в виде готового куска ответа (в пуле)
+    std::string exportPage(RawExport& state) {
+        size_t page = EXPORT_PAGE_ROWS;
+        if (state.remaining >= 0 && state.remaining < static_cast<int64_t>(page)) {
+            page = static_cast<size_t>(state.remaining);
+        }
+        
+        std::vector<Sample> samples;
+        if (page > 0) {
+            database->getSamplesPage(state.start_ms, state.end_ms, state.cursor, page, samples, state.sensor_id);
+        }
+        
+        std::ostringstream body;
+        body << std::fixed << std::setprecision(2);
+        for (const auto& sample : samples) {
+            if (!state.first) body << ",";
+            state.first = false;
+            body << "{\"timestamp\": \"" << formatTimestampMs(sample.ts_ms) << "\", "
+                 << "\"temperature\": " << sample.value << "}";
+        }
+        
+        if (state.remaining > 0) state.remaining -= static_cast<int64_t>(samples.size());
+        state.finished = samples.size() < page || state.remaining == 0;
+        if (state.finished) body << "]";
+        
+        std::string chunk = exportChunk(body.str(), state.chunked);
+        if (state.finished && state.chunked) chunk += "0\r\n\r\n";
+        return chunk;
+    }
+    
+    // Заказываем у пула следующую страницу. false - очередь пула полна
+    bool fetchExportPage(Connection& conn) {
+        std::shared_ptr<RawExport> state = conn.raw_export;
+        SOCKET sock = conn.socket;
+        uint64_t id = conn.id;
+        
+        state->fetching = true;
+        bool queued = workers.submit(WorkerPool::PRIORITY_SLOW, [this, sock, id, state]() {
+            Completion done;
+            done.socket = sock;
+            done.connection_id = id;
+            done.response = exportPage(*state);
+            done.partial = !state->finished;
+            {
+                std::lock_guard<std::mutex> lock(completions_mutex);
+                completions.push_back(std::move(done));
+            }
+            wakeLoop();
+        });
+        
+        if (!queued) state->fetching = false;
+        return queued;
+    }
+    
+    // Выгрузка без ограничения по числу строк: заголовки сразу, строки идут
+    // страницами по мере того, как клиент их забирает, поэтому память не
+    // зависит от размера диапазона. false - параметры не подходят, запрос
+    // выполнится обычным путем (и вернет ошибку)
+    bool startExport(Connection& conn, const std::map<std::string, std::string>& params,
+                     bool chunked, bool keep_alive) {
+        auto start_it = params.find("start");
+        auto end_it = params.find("end");
+        auto limit_it = params.find("limit");
+        
+        std::shared_ptr<RawExport> state = std::make_shared<RawExport>();
+        if (start_it == params.end() || end_it == params.end() || !sensorParam(params, state->sensor_id) ||
+            !parseTimestampMs(start_it->second, state->start_ms) ||
+            !parseTimestampMs(end_it->second, state->end_ms)) {
+            return false;
+        }
+        
+        if (limit_it != params.end()) {
+            char* end = nullptr;
+            long long limit = strtoll(limit_it->second.c_str(), &end, 10);
+            if (end == limit_it->second.c_str() || *end != '\0') return false;
+            if (limit > 0) state->remaining = limit;
+        }
+        state->chunked = chunked;
+        
+        conn.output += "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: application/json\r\n";
+        if (chunked) conn.output += "Transfer-Encoding: chunked\r\n";
+        conn.output += "Access-Control-Allow-Origin: *\r\n";
+        conn.output += chunked && keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        conn.output += exportChunk("[", chunked);
+        
+        // Без chunked конец ответа - закрытие соединения
+        if (!chunked) conn.close_after_write = true;
+        
+        conn.raw_export = state;
+        conn.busy = true;
+        if (!fetchExportPage(conn)) {
+            std::cerr << "Export rejected: worker queue is full\n";
+            conn.raw_export.reset();
+            conn.busy = false;
+            conn.close_after_write = true;
+        }
+        return true;
+    }
+    
+    // Отправляем накопленное и, если сокет почти все забрал, заказываем
+    // следующую страницу. false - соединение нужно закрыть
+    bool continueExport(Connection& conn) {
+        size_t backlog = conn.output.size() - conn.output_sent;
+        if (!writeConnection(conn)) return false;
+        if (conn.output.size() - conn.output_sent < backlog) conn.last_active = std::chrono::steady_clock::now();
+        
+        RawExport* state = conn.raw_export.get();
+        if (!state || state->fetching || state->finished) return true;
+        if (conn.output.size() - conn.output_sent > EXPORT_LOW_WATER) return true;
+        
+        if (fetchExportPage(conn)) return true;
+        
+        // Оборванный chunked-ответ клиент распознает как ошибку
+        std::cerr << "Export aborted: worker queue is full\n";
+        return false;
+    }
+    
+    // Событие SSE с замером в том же виде, что и элементы /api/raw, и номером датчика
+    static std::string sampleEvent(const Sample& sample) {
+        std::ostringstream event;
+        event << "data: {\"sensor\": " << sample.sensor_id << ", "
+              << "\"timestamp\": \"" << formatTimestampMs(sample.ts_ms) << "\", "
+              << "\"temperature\": " << std::fixed << std::setprecision(2) << sample.value << "}\n\n";
+        return event.str();
+    }
+    
+    // Соединение становится подпиской: заголовки без длины и сразу
+    // последний замер каждого датчика (или только ?sensor=), дальше
+    // только события из publishSample
+    void startStream(Connection& conn, const std::map<std::string, std::string>& params) {
+        uint32_t sensor_id;
+        bool filtered = params.count("sensor") > 0;
+        if (!sensorParam(params, sensor_id)) {
+            conn.output += "HTTP/1.1 400 Bad Request\r\n"
+                           "Content-Length: 0\r\n"
+                           "Connection: close\r\n\r\n";
+            conn.close_after_write = true;
+            return;
+        }
+        
+        conn.output += "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Access-Control-Allow-Origin: *\r\n"
+                       "Connection: keep-alive\r\n"
+                       "\r\n"
+                       "retry: 3000\n\n";
+        
+        if (recent_samples) {
+            recent_samples->forEach([&](uint32_t id, const SampleRing& ring) {
+                Sample latest;
+                if ((!filtered || id == sensor_id) && ring.latest(latest)) conn.output += sampleEvent(latest);
+            });
+        }
+        
+        // Без этого ядро само растит буфер отправки до мегабайт, и медленный
+        // подписчик копит данные там, а не в нашей ограниченной очереди
+        int sndbuf = SSE_CLIENT_BACKLOG;
+        setsockopt(conn.socket, SOL_SOCKET, SO_SNDBUF, (const char*)&sndbuf, sizeof(sndbuf));
+        
+        conn.streaming = true;
+        conn.stream_sensor = filtered ? static_cast<int64_t>(sensor_id) : -1;
+        conn.close_after_write = false;
+        ++stream_clients;
+    }
+    
+    // Дописываем текст подписчику. Кто не успевает забирать, отключается,
+    // чтобы не копить для него память
+    bool pushToStream(Connection& conn, const std::string& text) {
+        if (conn.output.size() - conn.output_sent + text.size() > SSE_CLIENT_BACKLOG) {
+            std::cerr << "Stream client too slow, disconnecting\n";
+            return false;
+        }
+        conn.output += text;
+        conn.last_active = std::chrono::steady_clock::now();
+        return writeConnection(conn);
+    }
+    
+    // Раздаем накопленные события всем подписчикам
+    void drainStreamEvents() {
+        std::vector<std::pair<uint32_t, std::string>> events;
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            if (stream_events.empty()) return;
+            events.swap(stream_events);
+        }
+        
+        // Текст для каждого фильтра собираем один раз на всех его подписчиков
+        std::map<int64_t, std::string> texts;
+        for (auto& item : connections) {
+            if (item.second->streaming) texts[item.second->stream_sensor];
+        }
+        for (auto& text : texts) {
+            for (const auto& event : events) {
+                if (text.first < 0 || text.first == event.first) text.second += event.second;
+            }
+        }
+        
+        std::vector<SOCKET> dropped;
+        for (auto& item : connections) {
+            if (!item.second->streaming) continue;
+            
+            const std::string& text = texts[item.second->stream_sensor];
+            if (!text.empty() && !pushToStream(*item.second, text)) {
+                dropped.push_back(item.first);
+            }
+        }
+        for (SOCKET sock : dropped) closeConnection(sock);
+    }
+    
+    // Разбираем принятые байты: очередной полный запрос уходит в пул, пока
+    // он выполняется, остальные (конвейер) ждут в input, чтобы ответы шли по порядку.
+    // false - соединение нужно закрыть
+    bool processInput(Connection& conn) {
+        // Подписчик ничего больше не присылает, а если присылает - не слушаем
+        if (conn.streaming) {
+            conn.input.clear();
+            if (conn.peer_closed) return false;
+            return writeConnection(conn);
+        }
+        
+        size_t consumed = 0;
+        while (!conn.close_after_write && !conn.busy && !conn.streaming) {
+            bool too_large = false;
+            size_t length = completeRequestLength(conn.input, consumed, too_large);
+            
+            if (too_large) {
+                conn.output += "HTTP/1.1 413 Payload Too Large\r\n"
+                               "Content-Length: 0\r\n"
+                               "Connection: close\r\n\r\n";
+                conn.close_after_write = true;
+                break;
+            }
+            if (length == 0) break;
+            
+            std::string request = conn.input.substr(consumed, length);
+            consumed += length;
+            
+            bool keep_alive = wantsKeepAlive(request) && !conn.peer_closed;
+            if (!keep_alive) conn.close_after_write = true;
+            dispatchRequest(conn, request, keep_alive);
+        }
+        conn.input.erase(0, consumed);
+        
+        if (conn.peer_closed && !conn.busy) conn.close_after_write = true;
+        if (conn.close_after_write) conn.input.clear();
+        if (conn.close_after_write && !conn.busy && conn.output.empty()) return false;
+        
+        return writeConnection(conn);
+    }
+    
+    // Читаем все, что есть в сокете. false - соединение нужно закрыть
+    bool readConnection(Connection& conn) {
+        char buffer[4096];
+        
+        for (;;) {
+            int received = recv(conn.socket, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                conn.input.append(buffer, received);
+                if (received < static_cast<int>(sizeof(buffer))) break;
+                continue;
+            }
+            if (received == 0) {
+                // Клиент закрыл свою сторону: отвечаем на принятое и закрываем,
+                // читать из сокета больше нечего
+                conn.peer_closed = true;
+                watchSocket(conn.socket, false, conn.want_write, false);
+                break;
+            }
+            
+            int error = getErrorCode();
+            if (wouldBlock(error)) break;
+            #if !defined (WIN32)
+                if (error == EINTR) continue;
+            #endif
+            return false;
+        }
+        
+        conn.last_active = std::chrono::steady_clock::now();
+        return processInput(conn);
+    }
+    
+    // Ответы из пула дописываем в свои соединения и берем следующие запросы
+    void drainCompletions() {
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(completions_mutex);
+            if (completions.empty()) return;
+            ready.swap(completions);
+        }
+        
+        for (auto& done : ready) {
+            auto it = connections.find(done.socket);
+            if (it == connections.end() || it->second->id != done.connection_id) continue;
+            
+            Connection& conn = *it->second;
+            conn.output += done.response;
+            conn.last_active = std::chrono::steady_clock::now();
+            
+            if (done.partial) {
+                conn.raw_export->fetching = false;
+                if (!continueExport(conn)) closeConnection(done.socket);
+                continue;
+            }
+            
+            conn.raw_export.reset();
+            conn.busy = false;
+            if (!processInput(conn)) closeConnection(done.socket);
+        }
+    }
+    
+    // Отправляем сколько примет сокет, остаток ждет EPOLLOUT.
+    // false - соединение нужно закрыть
+    bool writeConnection(Connection& conn) {
+        while (conn.output_sent < conn.output.size()) {
+            #if defined (__linux__)
+                int flags = MSG_NOSIGNAL;
+            #else
+                int flags = 0;
+            #endif
+            int sent = send(conn.socket, conn.output.data() + conn.output_sent,
+                            static_cast<int>(conn.output.size() - conn.output_sent), flags);
+            if (sent > 0) {
+                // Медленный клиент, который забирает ответ, не простаивает
+                conn.output_sent += sent;
+                conn.last_active = std::chrono::steady_clock::now();
+                continue;
+            }
+            
+            int error = getErrorCode();
+            if (sent < 0 && wouldBlock(error)) break;
+            #if !defined (WIN32)
+                if (sent < 0 && error == EINTR) continue;
+            #endif
+            return false;
+        }
+        
+        bool drained = conn.output_sent == conn.output.size();
+        if (drained) {
+            conn.output.clear();
+            conn.output_sent = 0;
+            if (conn.close_after_write && !conn.busy) return false;
+        }
+        
+        if (conn.want_write != !drained) {
+            conn.want_write = !drained;
+            watchSocket(conn.socket, false, conn.want_write, !conn.peer_closed);
+        }
+        
+        return true;
+    }
+    
+    // Закрываем соединения, которые молчат дольше KEEPALIVE_TIMEOUT_SEC.
+    // В молчащие подписки шлем комментарий: запись в мертвое соединение его закроет
+    void closeIdleConnections() {
+        auto now = std::chrono::steady_clock::now();
+        auto deadline = now - std::chrono::seconds(KEEPALIVE_TIMEOUT_SEC);
+        auto heartbeat = now - std::chrono::seconds(SSE_HEARTBEAT_SEC);
+        
+        std::vector<SOCKET> idle;
+        for (auto& item : connections) {
+            Connection& conn = *item.second;
+            if (conn.streaming) {
+                if (conn.last_active < heartbeat && !pushToStream(conn, ": ping\n\n")) idle.push_back(item.first);
+            } else if (!conn.busy && conn.last_active < deadline) {
+                idle.push_back(item.first);
+            } else if (conn.raw_export && !conn.raw_export->fetching && conn.last_active < deadline) {
+                // Клиент выгрузки перестал забирать данные
+                idle.push_back(item.first);
+            }
+        }
+        for (SOCKET sock : idle) closeConnection(sock);
+    }
+    
+    void eventLoop() {
+        std::vector<IoEvent> events;
+        events.reserve(MAX_EVENTS);
+        auto last_idle_check = std::chrono::steady_clock::now();
+        
+        while (running) {
+            waitEvents(events);
+            
+            for (const auto& ev : events) {
+                if (ev.socket == server_socket) {
+                    acceptClients();
+                    continue;
+                }
+                
+                #if !defined (WIN32)
+                    if (ev.socket == wake_pipe[0]) {
+                        char drain[64];
+                        while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+                        continue;
+                    }
+                #endif
+                
+                auto it = connections.find(ev.socket);
+                if (it == connections.end()) continue;
+                
+                Connection& conn = *it->second;
+                bool keep = !ev.error;
+                if (keep && ev.writable) keep = conn.raw_export ? continueExport(conn) : writeConnection(conn);
+                if (keep && ev.readable && !conn.peer_closed) keep = readConnection(conn);
+                if (!keep) closeConnection(ev.socket);
+            }
+            
+            drainCompletions();
+            drainStreamEvents();
+            
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_idle_check >= std::chrono::milliseconds(LOOP_TICK_MS)) {
+                closeIdleConnections();
+                last_idle_check = now;
+            }
+        }
+        
+        std::vector<SOCKET> remaining;
+        for (const auto& item : connections) remaining.push_back(item.first);
+        for (SOCKET sock : remaining) closeConnection(sock);
+    }
+    
 public:
-    HTTPServer(Database* db, const std::string& ip = "0.0.0.0", int port = 8080)
-        : database(db), server_socket(INVALID_SOCKET), 
-          server_ip(ip), server_port(port), running(false) {
+    HTTPServer(Database* db, const SampleRings* recent = nullptr,
+               const std::string& ip = "0.0.0.0", int port = 8080,
+               size_t worker_threads = HTTP_WORKER_THREADS, size_t queue_depth = HTTP_QUEUE_DEPTH)
+        : database(db), recent_samples(recent), server_socket(INVALID_SOCKET), 
+          server_ip(ip), server_port(port), running(false),
+          worker_threads(worker_threads), queue_depth(queue_depth), next_connection_id(1),
+          stream_clients(0) {
+        
+        std::ostringstream boot;
+        boot << std::hex << currentTimeMs();
+        boot_id = boot.str();
         
         initializeNetwork();
-        memset(input_buf, 0, sizeof(input_buf));
+        #if defined (__linux__)
+            epoll_fd = -1;
+        #endif
+        #if !defined (WIN32)
+            wake_pipe[0] = wake_pipe[1] = -1;
+        #endif
     }
     
     ~HTTPServer() {
@@ -255,6 +1468,41 @@ public:
         cleanupNetwork();
     }
     
+    // Логгер закрыл интервал датчика: ответы, которые его касались, устарели.
+    // При запуске сюда же передается начало восстановленных открытых интервалов
+    // (TemperatureLogger::closedThrough) - раньше него все уже записано
+    void bucketClosed(uint32_t sensor_id, BucketAggregator::Period period, int64_t end_ms) {
+        ResponseCache::Group group = period == BucketAggregator::PERIOD_HOUR
+            ? ResponseCache::GROUP_HOURLY : ResponseCache::GROUP_DAILY;
+        
+        {
+            std::lock_guard<std::mutex> lock(closed_mutex);
+            int64_t& closed = closed_through[group][sensor_id];
+            if (end_ms > closed) closed = end_ms;
+        }
+        
+        response_cache.invalidate(group);
+    }
+    
+    // Новый замер для подписчиков /api/stream. Вызывается из потока логгера
+    // и не ждет сети: без подписчиков ничего не делает, при переполнении
+    // очереди событие теряется
+    void publishSample(const Sample& sample) {
+        if (stream_clients.load() == 0) return;
+        
+        std::string event = sampleEvent(sample);
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            if (stream_events.size() >= SSE_PENDING_EVENTS) return;
+            wake = stream_events.empty();
+            stream_events.emplace_back(sample.sensor_id, std::move(event));
+        }
+        // Цикл заберет все накопленное за одно пробуждение
+        if (wake) wakeLoop();
+    }
+    
+    // Открывает порт и запускает цикл обработки соединений в отдельном потоке
     bool start() {
         if (running) return true;
         
@@ -284,76 +1532,75 @@ public:
             return false;
         }
         
-        if (listen(server_socket, SOMAXCONN) == SOCKET_ERROR) {
+        if (listen(server_socket, SOMAXCONN) == SOCKET_ERROR || !setNonBlocking(server_socket)) {
             std::cerr << "Failed to listen: " << getErrorCode() << std::endl;
             closeSocket(server_socket);
             server_socket = INVALID_SOCKET;
             return false;
         }
         
+        #if !defined (WIN32)
+            if (pipe(wake_pipe) != 0) {
+                std::cerr << "Failed to create wake pipe: " << getErrorCode() << std::endl;
+                stop();
+                return false;
+            }
+            fcntl(wake_pipe[0], F_SETFL, fcntl(wake_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+            fcntl(wake_pipe[1], F_SETFL, fcntl(wake_pipe[1], F_GETFL, 0) | O_NONBLOCK);
+        #endif
+        
+        #if defined (__linux__)
+            epoll_fd = epoll_create1(0);
+            if (epoll_fd == -1) {
+                std::cerr << "Failed to create epoll: " << getErrorCode() << std::endl;
+                stop();
+                return false;
+            }
+            watchSocket(server_socket, true, false);
+            watchSocket(wake_pipe[0], true, false);
+        #endif
+        
+        if (!workers.start(worker_threads, queue_depth)) {
+            std::cerr << "Failed to start worker pool\n";
+            stop();
+            return false;
+        }
+        
         running = true;
+        io_thread = std::thread([this]() { eventLoop(); });
         return true;
     }
     
     void stop() {
         running = false;
+        wakeLoop();
+        if (io_thread.joinable()) {
+            io_thread.join();
+        }
+        
+        // Пул останавливаем до закрытия канала: задачи в работе еще будят цикл
+        workers.stop();
+        completions.clear();
+        
         if (server_socket != INVALID_SOCKET) {
             closeSocket(server_socket);
             server_socket = INVALID_SOCKET;
         }
-    }
     
-    void processClients() {
-        if (!running || server_socket == INVALID_SOCKET) return;
-        
-        struct pollfd pfd;
-        memset(&pfd, 0, sizeof(pfd));
-        pfd.fd = server_socket;
-        pfd.events = POLLIN;
-        
-        #if defined(WIN32)
-            int ret = WSAPoll(&pfd, 1, READ_WAIT_MS);
-        #else
-            int ret = poll(&pfd, 1, READ_WAIT_MS);
-        #endif
-        
-        if (ret > 0 && (pfd.revents & POLLIN)) {
-            SOCKET client_socket = accept(server_socket, NULL, NULL);
-            if (client_socket == INVALID_SOCKET) {
-                std::cerr << "Error: " << getErrorCode() << std::endl;
-                return;
-            }
-            
-            struct pollfd client_pfd;
-            memset(&client_pfd, 0, sizeof(client_pfd));
-            client_pfd.fd = client_socket;
-            client_pfd.events = POLLIN;
-            
-            #if defined(WIN32)
-                int poll_ret = WSAPoll(&client_pfd, 1, READ_WAIT_MS);
-            #else
-                int poll_ret = poll(&client_pfd, 1, READ_WAIT_MS);
-            #endif
-            
-            if (poll_ret <= 0) {
-                closeSocket(client_socket);
-                return;
+        #if defined (__linux__)
+            if (epoll_fd != -1) {
+                close(epoll_fd);
+                epoll_fd = -1;
             }
-            
-            int bytes_received = recv(client_socket, input_buf, sizeof(input_buf) - 1, 0);
-            if (bytes_received == SOCKET_ERROR || bytes_received == 0) {
-                closeSocket(client_socket);
-                return;
+        #endif
+        #if !defined (WIN32)
+            for (int i = 0; i < 2; ++i) {
+                if (wake_pipe[i] != -1) {
+                    close(wake_pipe[i]);
+                    wake_pipe[i] = -1;
+                }
             }
-            
-            input_buf[bytes_received] = '\0';
-            
-            std::string request(input_buf);
-            std::string response = handleRequest(request);
-            
-            send(client_socket, response.c_str(), response.length(), 0);
-            closeSocket(client_socket);
-        }
+        #endif
     }
 };
 
@@ -4,6 +4,9 @@
 #include <csignal>
 #include <atomic>
 #include <thread>
+#include <string>
+#include <vector>
+#include <cctype>
 
 std::atomic<bool> running(true);
 TemperatureLogger* logger = nullptr;
@@ -13,11 +16,19 @@ void signal_handler(int signal) {
     if (signal == SIGINT || signal == SIGTERM) running = false;
 }
 
-void server_loop() {
-    while (running) {
-        if (http_server) http_server->processClients();
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+// Порт датчика: "id:/dev/ttyUSB0" или просто имя порта, тогда номер
+// датчика - его позиция в командной строке
+TemperatureLogger::SensorConfig parse_sensor(const std::string& arg, uint32_t position) {
+    TemperatureLogger::SensorConfig config = { position, arg };
+    size_t colon = arg.find(':');
+    if (colon == std::string::npos || colon == 0 || colon > 9) return config;
+    
+    for (size_t i = 0; i < colon; ++i) {
+        if (!isdigit(static_cast<unsigned char>(arg[i]))) return config;
     }
+    config.sensor_id = static_cast<uint32_t>(std::stoul(arg.substr(0, colon)));
+    config.port_name = arg.substr(colon + 1);
+    return config;
 }
 
 int main(int argc, char* argv[]) {
@@ -28,33 +39,73 @@ int main(int argc, char* argv[]) {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     
-    std::string serial_port = argv[1];
     std::string db_file = "temperature.db";
     
+    // temp_server <порт> [<порт>...] [--backpressure=block|drop-oldest|spill]
+    // --backpressure - что делать с замерами, если база не успевает
+    const std::string backpressure_flag = "--backpressure=";
+    SampleWriter::Backpressure backpressure = SampleWriter::BACKPRESSURE_BLOCK;
+    std::vector<TemperatureLogger::SensorConfig> sensors;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, backpressure_flag.size(), backpressure_flag) == 0) {
+            std::string policy = arg.substr(backpressure_flag.size());
+            if (!SampleWriter::parseBackpressure(policy, backpressure)) {
+                std::cerr << "Unknown backpressure policy: " << policy << "\n";
+                return 1;
+            }
+        } else {
+            sensors.push_back(parse_sensor(arg, static_cast<uint32_t>(sensors.size())));
+        }
+    }
+    
     try {
         // Инициализируем логгер
         logger = new TemperatureLogger();
-        if (!logger->initialize(db_file, serial_port)) {
+        if (!logger->initialize(db_file, sensors)) {
             std::cerr << "Failed to initialize logger\n";
             delete logger;
             return 1;
         }
+        logger->setBackpressure(backpressure);
+        
+        // HTTP сервер создается до запуска логгера, чтобы слушатели,
+        // заданные ниже, его видели; соединения он принимает только после
+        // восстановления интервалов в logger->start()
+        http_server = new HTTPServer(&logger->getDatabase(), &logger->getRecentSamples(), "0.0.0.0", 8080);
+        
+        // Закрытые логгером часы и сутки сбрасывают кэш ответов сервера
+        logger->setBucketListener([](uint32_t sensor_id, BucketAggregator::Period period,
+                                     const BucketAggregator::Bucket& bucket) {
+            if (http_server) http_server->bucketClosed(sensor_id, period, bucket.end_ms);
+        });
+        
+        // Новые замеры сразу уходят подписчикам /api/stream
+        logger->setSampleListener([](const Sample& sample) {
+            if (http_server) http_server->publishSample(sample);
+        });
+        
+        // Запускаем логгер: он восстанавливает открытые час и сутки из базы
+        logger->start();
+        
+        // Неизменными сервер считает только интервалы, которые логгер уже
+        // записал, - открытые после восстановления еще дописываются
+        for (const auto& sensor : sensors) {
+            http_server->bucketClosed(sensor.sensor_id, BucketAggregator::PERIOD_HOUR,
+                                      logger->closedThrough(sensor.sensor_id, BucketAggregator::PERIOD_HOUR));
+            http_server->bucketClosed(sensor.sensor_id, BucketAggregator::PERIOD_DAY,
+                                      logger->closedThrough(sensor.sensor_id, BucketAggregator::PERIOD_DAY));
+        }
         
-        // Инициализируем HTTP сервер
-        http_server = new HTTPServer(&logger->getDatabase(), "0.0.0.0", 8080);
+        // Соединения обслуживает собственный поток сервера
         if (!http_server->start()) {
             std::cerr << "Failed to start HTTP server\n";
+            logger->stop();
             delete http_server;
             delete logger;
             return 1;
         }
         
-        // Запускаем логгер
-        logger->start();
-        
-        // Запускаем поток для обработки HTTP запросов
-        std::thread server_thread(server_loop);
-        
         // Главный цикл
         while (running) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -64,10 +115,6 @@ int main(int argc, char* argv[]) {
         logger->stop();
         http_server->stop();
         
-        if (server_thread.joinable()) {
-            server_thread.join();
-        }
-        
         delete http_server;
         delete logger;
         
@@ -1,3 +1,6 @@
+#ifndef MY_SERIAL_HPP
+#define MY_SERIAL_HPP
+
 #if defined (WIN32)
 #	include <Windows.h>        // HANDLE и все функции read/write
 #	define MY_PORT_HANDLE      HANDLE
@@ -223,7 +226,9 @@ namespace cplib
 			if (!::CloseHandle(_phandle))
 				ret = RE_PORT_SYSTEM_ERROR;
 #else
-			tcflush(_phandle, TCIOFLUSH);
+			// Непрочитанный ввод выбрасываем, а записанное должно дойти:
+			// TCIOFLUSH терял хвост вывода, еще не забранный устройством
+			tcflush(_phandle, TCIFLUSH);
 			if (::close(_phandle) < 0)
 				ret = RE_PORT_SYSTEM_ERROR;
 #endif
@@ -367,7 +372,7 @@ namespace cplib
 			// Сконвертируем параметры класса в системные параметры COM-порта
 			MY_PORT_SETTINGS setts;
 			int ret = ParamsToSystem(inp_params, setts);
-			if (!ret)
+			if (ret != RE_OK)
 				return ret;
 #if defined(WIN32)
 			// Системный вызов установки параметров
@@ -426,6 +431,11 @@ namespace cplib
 		bool IsOpen() const {
 			return (_phandle != MY_INVALID_HANDLE);
 		}
+		// Системный дескриптор порта, например для epoll.
+		// Закрывать его нужно только через Close()
+		MY_PORT_HANDLE GetHandle() const {
+			return _phandle;
+		}
 		// Имя порта
 		const std::string& GetPortName() {
 			return _port_name;
@@ -486,11 +496,11 @@ namespace cplib
 			if (written)
 				*written = feedback;
 #else
-			size_t result = write(_phandle, buf, buf_size);
+			ssize_t result = write(_phandle, buf, buf_size);
 			if (result < 0)
 				return RE_PORT_WRITE_FAILED;
 			if (written)
-				*written = result;
+				*written = (size_t)result;
 #endif
 			return RE_OK;
 		}
@@ -519,9 +529,31 @@ namespace cplib
 			*readd = (size_t)feedback;
 #else
 			int res = read(_phandle, buf, max_size);
-			if (res < 0)
+			if (res < 0) {
+				// В неблокирующем режиме "нет данных" - не ошибка
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return RE_OK;
 				return RE_PORT_READ_FAILED;
+			}
 			*readd = (size_t)res;
+#endif
+			return RE_OK;
+		}
+		// Неблокирующий режим: Read() сразу возвращает то, что уже пришло.
+		// Ждать данных в этом режиме нужно через epoll (SerialReactor)
+		int SetNonBlocking(bool enable) {
+			if (!IsOpen())
+				return RE_PORT_NOT_CONNECTED;
+#if defined(WIN32)
+			// В Windows остаемся на блокирующем чтении с таймаутом SetTimeout()
+			(void)enable;
+#else
+			int flags = fcntl(_phandle, F_GETFL, 0);
+			if (flags < 0)
+				return RE_PORT_PARAMETERS_GET_FAILED;
+			flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+			if (fcntl(_phandle, F_SETFL, flags) < 0)
+				return RE_PORT_PARAMETERS_SET_FAILED;
 #endif
 			return RE_OK;
 		}
@@ -552,6 +584,20 @@ namespace cplib
 			return RE_OK;
 		}
 
+		// Дождаться, пока устройство заберет все записанное
+		int Drain() {
+			if (!IsOpen())
+				return RE_PORT_NOT_CONNECTED;
+#if defined(WIN32)
+			if (!FlushFileBuffers(_phandle))
+				return RE_PORT_SYSTEM_ERROR;
+#else
+			if (tcdrain(_phandle) != 0)
+				return RE_PORT_SYSTEM_ERROR;
+#endif
+			return RE_OK;
+		}
+
 		// Операторы для удобного чтения\записи строк
 		SerialPort& operator<< (const std::string& data) {Write(data); return *this;}
 		SerialPort& operator>> (std::string& data) {Read(data); return *this;}
@@ -568,3 +614,5 @@ namespace cplib
 		SerialPort& operator= (const SerialPort& port){return *this;}
 	};
 }
+
+#endif
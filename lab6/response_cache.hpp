@@ -0,0 +1,102 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// Сколько ответов держим в кэше
+#define RESPONSE_CACHE_CAPACITY 1024
+
+// Кэш готовых тел ответов по нормализованному запросу.
+// Ответ, который покрывает только закрытые интервалы, больше не меняется
+// (immutable) и живет до вытеснения. Остальные сбрасываются invalidate()
+// своей группы (часовые или суточные), когда логгер закрывает интервал.
+// Счетчик поколений группы не дает положить в кэш ответ, посчитанный
+// до сброса, но сохраняемый после него
+class ResponseCache {
+public:
+    enum Group {
+        GROUP_HOURLY = 0,
+        GROUP_DAILY,
+        GROUP_COUNT
+    };
+
+    typedef std::shared_ptr<const std::string> Body;
+
+    explicit ResponseCache(size_t capacity = RESPONSE_CACHE_CAPACITY) : capacity(capacity) {
+        for (int i = 0; i < GROUP_COUNT; ++i) generations[i] = 0;
+    }
+
+    Body find(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        return it != entries.end() ? it->second.body : Body();
+    }
+
+    // Поколение группы на момент начала запроса к базе
+    uint64_t generation(Group group) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return generations[group];
+    }
+
+    void store(const std::string& key, Group group, uint64_t generation, bool immutable, Body body) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (generations[group] != generation) return;
+
+        if (entries.size() >= capacity && entries.find(key) == entries.end()) {
+            evictLocked();
+        }
+
+        Entry& entry = entries[key];
+        entry.body = body;
+        entry.group = group;
+        entry.immutable = immutable;
+    }
+
+    // Сбрасывает изменяемые ответы группы
+    void invalidate(Group group) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generations[group];
+
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second.group == group && !it->second.immutable) {
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        Body body;
+        Group group;
+        bool immutable;
+    };
+
+    // Места нет: сначала выбрасываем изменяемые ответы, если не помогло - все
+    void evictLocked() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (!it->second.immutable) {
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (entries.size() >= capacity) entries.clear();
+    }
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t generations[GROUP_COUNT];
+    const size_t capacity;
+
+    ResponseCache(const ResponseCache&);
+    ResponseCache& operator=(const ResponseCache&);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef RETENTION_HPP
+#define RETENTION_HPP
+
+#include "database.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+#define RETENTION_KEEP_DAYS 30
+#define RETENTION_INTERVAL_SEC 3600     // проход раз в час: за раз удаляется немного
+#define RETENTION_BATCH_ROWS 2000       // строк за одну транзакцию удаления
+#define RETENTION_PAUSE_MS 20           // пауза между порциями, база свободна для записи
+#define RETENTION_VACUUM_PAGES 256      // страниц за один incremental_vacuum
+
+// Фоновая очистка старых замеров в своем потоке. Удаляет порциями по
+// индексу, каждая порция - короткая транзакция, между порциями пауза,
+// поэтому запись замеров и запросы API не ждут дольше одной порции.
+// После удаления возвращает свободные страницы файлу и обрезает WAL
+class RetentionWorker {
+public:
+    struct Report {
+        uint64_t rows_deleted;
+        uint64_t batches;
+        int64_t bytes_reclaimed;    // на сколько уменьшился файл базы
+        double longest_batch_ms;    // дольше всего база была занята одной порцией
+        double seconds;
+
+        Report() : rows_deleted(0), batches(0), bytes_reclaimed(0), longest_batch_ms(0), seconds(0) {}
+    };
+
+    explicit RetentionWorker(Database& db, int keep_days = RETENTION_KEEP_DAYS)
+        : db(db), keep_days(keep_days), stopping(false) {}
+
+    ~RetentionWorker() {
+        stop();
+    }
+
+    void start() {
+        if (worker.joinable()) return;
+
+        stopping = false;
+        worker = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping) {
+                lock.unlock();
+                runPass();
+                lock.lock();
+
+                wakeup.wait_for(lock, std::chrono::seconds(RETENTION_INTERVAL_SEC),
+                                [this]() { return stopping; });
+            }
+        });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+
+        if (worker.joinable()) worker.join();
+    }
+
+    // Один проход: удаление, возврат места, checkpoint. Вызывается потоком
+    // очистки, но можно и напрямую. stop() прерывает проход между порциями
+    Report runPass() {
+        Report report;
+        auto started = std::chrono::steady_clock::now();
+        int64_t bytes_before = db.fileBytes();
+
+        int64_t cutoff = Database::retentionCutoffMs(keep_days);
+        bool ok = true;
+        for (;;) {
+            auto batch_started = std::chrono::steady_clock::now();
+            size_t deleted = db.deleteOldBatch(cutoff, RETENTION_BATCH_ROWS, ok);
+            double batch_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - batch_started).count();
+            if (batch_ms > report.longest_batch_ms) report.longest_batch_ms = batch_ms;
+
+            if (deleted == 0) break;
+            report.rows_deleted += deleted;
+            ++report.batches;
+            if (!pause()) break;
+        }
+
+        // Свободные страницы есть и после прошлых проходов, прерванных stop()
+        while (db.vacuumStep(RETENTION_VACUUM_PAGES) > 0 && pause()) {}
+        db.checkpoint();
+
+        report.bytes_reclaimed = bytes_before - db.fileBytes();
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        if (!ok) {
+            std::cerr << "Retention pass failed\n";
+        }
+        if (report.rows_deleted > 0 || report.bytes_reclaimed > 0) {
+            std::cout << "Retention: deleted " << report.rows_deleted << " rows in " << report.batches
+                      << " batches, reclaimed " << report.bytes_reclaimed / 1024 << " KB in "
+                      << report.seconds << " s (longest batch " << report.longest_batch_ms << " ms)\n";
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        last_report = report;
+        return report;
+    }
+
+    Report lastReport() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return last_report;
+    }
+
+private:
+    // Пауза между порциями. false - поток останавливают
+    bool pause() {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait_for(lock, std::chrono::milliseconds(RETENTION_PAUSE_MS),
+                        [this]() { return stopping; });
+        return !stopping;
+    }
+
+    Database& db;
+    int keep_days;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread worker;
+    bool stopping;
+    Report last_report;
+
+    RetentionWorker(const RetentionWorker&);
+    RetentionWorker& operator=(const RetentionWorker&);
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SAMPLE_HPP
+#define SAMPLE_HPP
+
+#include <cstdint>
+
+// Один замер в компактном виде: время в мс от эпохи, значение и номер датчика.
+// Строки (метка времени, дата, час) получаются из ts_ms только на выходе
+struct Sample {
+    int64_t ts_ms;
+    float value;
+    uint32_t sensor_id;
+};
+
+static_assert(sizeof(Sample) == 16, "Sample must stay 16 bytes");
+
+#endif
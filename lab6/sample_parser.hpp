@@ -0,0 +1,152 @@
+#ifndef SAMPLE_PARSER_HPP
+#define SAMPLE_PARSER_HPP
+
+#include "sample.hpp"
+#include "time_utils.hpp"
+
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+
+// Разбор строки эмулятора
+//     {"temperature": 23.45, "timestamp": "2024-01-01 12:00:00.000", "checksum": 23.45}
+// за один проход без аллокаций и исключений. Принимается то же, что и
+// раньше: ключи temperature/checksum/timestamp или temp/chk/time в любом
+// порядке, число - до ближайшей ',' или '}', контрольная сумма должна
+// совпадать с температурой с точностью 0.01. Если метку времени разобрать
+// нельзя, берется now_ms
+
+enum SampleParseResult {
+    PARSE_OK = 0,
+    PARSE_INVALID_JSON,
+    PARSE_BAD_TEMPERATURE,
+    PARSE_BAD_CHECKSUM,
+    PARSE_CHECKSUM_MISMATCH
+};
+
+inline const char* sampleParseError(SampleParseResult result) {
+    switch (result) {
+    case PARSE_OK:                return "OK";
+    case PARSE_INVALID_JSON:      return "Invalid JSON";
+    case PARSE_BAD_TEMPERATURE:   return "Failed to parse temperature";
+    case PARSE_BAD_CHECKSUM:      return "Failed to parse checksum";
+    case PARSE_CHECKSUM_MISMATCH: return "Checksum error";
+    }
+    return "Unknown error";
+}
+
+namespace sample_parser_detail {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Совпадает ли текст с позиции p с ключом key (без открывающей кавычки)
+template <size_t N>
+inline bool matchKey(const char* p, const char* end, const char (&key)[N]) {
+    return static_cast<size_t>(end - p) >= N - 1 && memcmp(p, key, N - 1) == 0;
+}
+
+// Число как у std::stod: пробелы и '+' в начале допустимы, мусор после
+// числа игнорируется. Шестнадцатеричную запись не принимаем
+inline bool parseNumber(const char* p, const char* end, double& value) {
+    while (p != end && isSpace(*p)) ++p;
+    if (p != end && *p == '+') {
+        ++p;
+        if (p != end && (*p == '+' || *p == '-')) return false;
+    }
+    std::from_chars_result result = std::from_chars(p, end, value);
+    return result.ec == std::errc();
+}
+
+// Конец значения: первая ',' или '}' начиная с p
+inline const char* valueEnd(const char* p, const char* end) {
+    for (; p != end; ++p) {
+        if (*p == ',' || *p == '}') return p;
+    }
+    return nullptr;
+}
+
+}
+
+inline SampleParseResult parseSample(std::string_view line, int64_t now_ms, Sample& sample) {
+    using namespace sample_parser_detail;
+
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+
+    // Начала значений для полного и короткого набора ключей
+    const char* temperature = nullptr;
+    const char* checksum = nullptr;
+    const char* timestamp = nullptr;
+    const char* temp = nullptr;
+    const char* chk = nullptr;
+    const char* time = nullptr;
+
+    // Один проход по кавычкам: запоминаем первое вхождение каждого ключа
+    const char* p = begin;
+    while (p != end) {
+        const char* quote = static_cast<const char*>(memchr(p, '"', end - p));
+        if (!quote) break;
+        p = quote + 1;
+
+        if (p == end) break;
+        if (*p == 't') {
+            if (!temperature && matchKey(p, end, "temperature\":")) temperature = p + 13;
+            else if (!timestamp && matchKey(p, end, "timestamp\":")) timestamp = p + 11;
+            else if (!temp && matchKey(p, end, "temp\":")) temp = p + 6;
+            else if (!time && matchKey(p, end, "time\":")) time = p + 6;
+        } else if (*p == 'c') {
+            if (!checksum && matchKey(p, end, "checksum\":")) checksum = p + 10;
+            else if (!chk && matchKey(p, end, "chk\":")) chk = p + 5;
+        }
+
+        if (temperature && checksum && timestamp) break;
+    }
+
+    if (!temperature || !checksum || !timestamp) {
+        if (!temp || !chk || !time) return PARSE_INVALID_JSON;
+        temperature = temp;
+        checksum = chk;
+        timestamp = time;
+    }
+
+    const char* temperature_end = valueEnd(temperature, end);
+    if (!temperature_end) return PARSE_INVALID_JSON;
+
+    double value;
+    if (!parseNumber(temperature, temperature_end, value)) return PARSE_BAD_TEMPERATURE;
+
+    const char* checksum_end = valueEnd(checksum, end);
+    if (!checksum_end) return PARSE_INVALID_JSON;
+
+    double checksum_value;
+    if (!parseNumber(checksum, checksum_end, checksum_value)) return PARSE_BAD_CHECKSUM;
+
+    const double EPSILON = 0.01;
+    if (std::fabs(value - checksum_value) > EPSILON) return PARSE_CHECKSUM_MISMATCH;
+
+    // Метка времени в кавычках или до ',' / '}'. Пробелы после ':' пропускаем
+    while (timestamp != end && isSpace(*timestamp)) ++timestamp;
+
+    const char* time_begin = timestamp;
+    const char* time_end = timestamp != end
+        ? static_cast<const char*>(memchr(timestamp + 1, '"', end - timestamp - 1))
+        : nullptr;
+    if (time_end) {
+        ++time_begin;
+    } else {
+        time_end = valueEnd(timestamp, end);
+        if (!time_end) return PARSE_INVALID_JSON;
+    }
+
+    if (!parseTimestampMs(time_begin, time_end - time_begin, sample.ts_ms)) {
+        sample.ts_ms = now_ms;
+    }
+    sample.value = static_cast<float>(value);
+    sample.sensor_id = 0;
+    return PARSE_OK;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SAMPLE_QUEUE_HPP
+#define SAMPLE_QUEUE_HPP
+
+#include "sample.hpp"
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Ограниченная очередь замеров без блокировок (схема Вьюкова): у каждой
+// ячейки свой счетчик, по нему производитель узнает, что ячейка свободна,
+// а потребитель - что она заполнена. Позиции занимаются через CAS, поэтому
+// класть могут несколько потоков сразу. Забирает в основном поток записи,
+// но pop безопасен и для производителей - так вытесняется самый старый
+// замер, когда места нет
+class SampleQueue {
+public:
+    // Емкость округляется вверх до степени двойки
+    explicit SampleQueue(size_t capacity)
+        : mask(roundUp(capacity) - 1), cells(new Cell[mask + 1]),
+          enqueue_pos(0), dequeue_pos(0) {
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // false - очередь полна
+    bool push(const Sample& sample) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->sample = sample;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // false - очередь пуста (или самый старый замер еще дописывается)
+    bool pop(Sample& sample) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        sample = cell->sample;
+        cell->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Приблизительно: позиции читаются не одновременно
+    size_t size() const {
+        size_t tail = enqueue_pos.load(std::memory_order_acquire);
+        size_t head = dequeue_pos.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        Sample sample;
+    };
+
+    static size_t roundUp(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+
+    // Разнесены по разным строкам кэша: их меняют разные потоки
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+
+    SampleQueue(const SampleQueue&);
+    SampleQueue& operator=(const SampleQueue&);
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef SAMPLE_RING_HPP
+#define SAMPLE_RING_HPP
+
+#include "sample.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+// Сколько последних замеров держим в памяти (~68 минут при 1 Гц)
+#define SAMPLE_RING_CAPACITY 4096
+
+// Кольцо последних замеров: один писатель (поток чтения порта),
+// сколько угодно читателей (HTTP) без блокировок.
+// Каждая ячейка защищена счетчиком версии (seqlock): писатель делает его
+// нечетным на время записи, читатель повторяет чтение, если счетчик
+// изменился или ячейка уже перезаписана более новым замером
+class SampleRing {
+public:
+    explicit SampleRing(size_t capacity = SAMPLE_RING_CAPACITY)
+        : slots(new Slot[capacity]), capacity(capacity), head(0) {}
+
+    // Только для потока-писателя
+    void push(const Sample& sample) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[index % capacity];
+
+        slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.ts_ms.store(sample.ts_ms, std::memory_order_relaxed);
+        slot.value.store(sample.value, std::memory_order_relaxed);
+        slot.sensor_id.store(sample.sensor_id, std::memory_order_relaxed);
+        slot.seq.store(2 * index + 2, std::memory_order_release);
+
+        head.store(index + 1, std::memory_order_release);
+    }
+
+    // Сколько замеров записано за все время
+    uint64_t count() const {
+        return head.load(std::memory_order_acquire);
+    }
+
+    bool latest(Sample& sample) const {
+        for (;;) {
+            uint64_t h = count();
+            if (h == 0) return false;
+            if (read(h - 1, sample)) return true;
+        }
+    }
+
+    // Замеры из [start_ms, end_ms], от новых к старым, не больше limit.
+    // Возвращает false, если начало диапазона уже вытеснено из кольца и
+    // ответ надо брать из базы
+    bool collect(int64_t start_ms, int64_t end_ms, size_t limit, std::vector<Sample>& out) const {
+        out.clear();
+
+        uint64_t h = count();
+        uint64_t oldest = h > capacity ? h - capacity : 0;
+
+        for (uint64_t index = h; index > oldest; --index) {
+            Sample sample;
+            if (!read(index - 1, sample)) return false;
+
+            if (sample.ts_ms < start_ms) return true;
+            if (sample.ts_ms > end_ms) continue;
+
+            out.push_back(sample);
+            if (out.size() >= limit) return true;
+        }
+
+        return false;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        std::atomic<int64_t> ts_ms;
+        std::atomic<float> value;
+        std::atomic<uint32_t> sensor_id;
+
+        Slot() : seq(0), ts_ms(0), value(0.0f), sensor_id(0) {}
+    };
+
+    // Читает замер с порядковым номером index, false - если он уже перезаписан
+    bool read(uint64_t index, Sample& sample) const {
+        const Slot& slot = slots[index % capacity];
+        const uint64_t expected = 2 * index + 2;
+
+        for (;;) {
+            uint64_t before = slot.seq.load(std::memory_order_acquire);
+            if (before > expected) return false;
+
+            sample.ts_ms = slot.ts_ms.load(std::memory_order_relaxed);
+            sample.value = slot.value.load(std::memory_order_relaxed);
+            sample.sensor_id = slot.sensor_id.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            uint64_t after = slot.seq.load(std::memory_order_relaxed);
+            if (before == expected && after == expected) return true;
+            if (after > expected) return false;
+        }
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    const size_t capacity;
+    std::atomic<uint64_t> head;
+
+    SampleRing(const SampleRing&);
+    SampleRing& operator=(const SampleRing&);
+};
+
+// Кольца по датчикам, у каждого свое: частый датчик не вытесняет из
+// памяти замеры редкого. Набор задается до запуска логгера и дальше не
+// меняется, поэтому поиск из потоков HTTP идет без блокировок
+class SampleRings {
+public:
+    SampleRings() {}
+
+    // Только до запуска логгера
+    SampleRing& add(uint32_t sensor_id, size_t capacity = SAMPLE_RING_CAPACITY) {
+        std::unique_ptr<SampleRing>& ring = rings[sensor_id];
+        if (!ring) ring.reset(new SampleRing(capacity));
+        return *ring;
+    }
+
+    // nullptr - такого датчика нет
+    const SampleRing* find(uint32_t sensor_id) const {
+        auto it = rings.find(sensor_id);
+        return it != rings.end() ? it->second.get() : nullptr;
+    }
+
+    // fn(sensor_id, ring) для каждого датчика по возрастанию номера
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (const auto& item : rings) fn(item.first, *item.second);
+    }
+
+private:
+    std::map<uint32_t, std::unique_ptr<SampleRing>> rings;
+
+    SampleRings(const SampleRings&);
+    SampleRings& operator=(const SampleRings&);
+};
+
+#endif
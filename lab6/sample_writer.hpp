@@ -0,0 +1,420 @@
+#ifndef SAMPLE_WRITER_HPP
+#define SAMPLE_WRITER_HPP
+
+#include "database.hpp"
+#include "sample_queue.hpp"
+#include "aggregator.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+#define WRITE_QUEUE_CAPACITY 65536      // ~18 часов при 1 Гц, ~3 с при 20 кГц
+#define WRITE_BATCH_MAX 1024            // замеров за одну транзакцию
+#define WRITE_IDLE_WAIT_MS 100          // страховочный таймаут сна потока записи
+#define WRITE_BLOCK_WAIT_MS 1           // сколько производитель ждет места за раз
+#define WRITE_REPORT_SEC 10             // не чаще раза в столько секунд пишем о потерях
+#define WRITE_RETRY_COUNT 3             // повторов пачки, которую база не приняла
+#define WRITE_RETRY_WAIT_MS 50          // пауза перед первым повтором, дальше вдвое больше
+
+// Асинхронная запись замеров: производители (поток чтения порта) кладут
+// замеры в очередь без блокировок, отдельный поток забирает все, что
+// накопилось, и пишет одной транзакцией. Пока идет транзакция, очередь
+// копит следующую пачку, так что размер пачки сам растет с нагрузкой.
+// Остановка базы (checkpoint, очистка) задерживает только поток записи.
+// Когда очередь полна, поведение задает Backpressure. Пачку, которую база
+// не приняла и после повторов, откладываем в файл переполнения (если он
+// задан) до следующего воспроизведения, иначе она теряется.
+// Закрытые часы и сутки идут через тот же поток отдельной очередью
+class SampleWriter {
+public:
+    enum Backpressure {
+        BACKPRESSURE_BLOCK,         // производитель ждет места, замеры не вытесняются
+        BACKPRESSURE_DROP_OLDEST,   // вытесняем самый старый замер из очереди
+        BACKPRESSURE_SPILL          // лишнее дописываем в файл, запишем позже
+    };
+
+    struct Stats {
+        size_t depth;               // замеров в очереди сейчас
+        size_t max_depth;           // наибольшая глубина, замеченная потоком записи
+        uint64_t accepted;          // принято, включая ушедшие в файл
+        uint64_t written;
+        uint64_t dropped;           // вытеснено или не принято
+        uint64_t spilled;           // ушло в файл переполнения
+        uint64_t blocked;           // сколько раз производитель ждал места
+        uint64_t failed_batches;    // пачки, которые база не приняла и после повторов
+    };
+
+    // Закрытый час или сутки датчика
+    struct ClosedBucket {
+        uint32_t sensor_id;
+        BucketAggregator::Period period;
+        BucketAggregator::Bucket bucket;
+    };
+
+    // Пишет закрытый интервал в базу. Вызывается из потока записи
+    typedef std::function<void(const ClosedBucket&)> BucketHandler;
+
+    explicit SampleWriter(Database& db, size_t capacity = WRITE_QUEUE_CAPACITY)
+        : db(db), queue(capacity), policy(BACKPRESSURE_BLOCK),
+          running(false), stopping(false), writer_idle(false),
+          spill_file(nullptr), replay_file(nullptr), spill_pending(false), buckets_pending(false),
+          accepted(0), written(0), dropped(0), spilled(0), blocked(0),
+          failed_batches(0), max_depth(0) {}
+
+    ~SampleWriter() {
+        stop();
+    }
+
+    // Задается до start(). Для BACKPRESSURE_SPILL нужен путь к файлу
+    void setBackpressure(Backpressure value) { policy = value; }
+    void setSpillPath(const std::string& path) { spill_path = path; }
+    void setBucketHandler(BucketHandler handler) { bucket_handler = handler; }
+
+    static bool parseBackpressure(const std::string& name, Backpressure& value) {
+        if (name == "block") {
+            value = BACKPRESSURE_BLOCK;
+        } else if (name == "drop-oldest") {
+            value = BACKPRESSURE_DROP_OLDEST;
+        } else if (name == "spill") {
+            value = BACKPRESSURE_SPILL;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void start() {
+        if (running) return;
+
+        // Файлы переполнения, оставшиеся от прошлого запуска, дописываем в базу.
+        // После падения посреди воспроизведения часть замеров запишется дважды
+        if (!spill_path.empty()) {
+            replay_file = fopen(replayPath().c_str(), "rb");
+            FILE* leftover = fopen(spill_path.c_str(), "rb");
+            if (leftover) {
+                fclose(leftover);
+                spill_pending = true;
+            }
+        }
+
+        stopping = false;
+        running = true;
+        worker = std::thread([this]() { writerLoop(); });
+    }
+
+    // Дописывает все, что осталось в очереди и в файле переполнения
+    void stop() {
+        if (!running) return;
+
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+
+        if (worker.joinable()) worker.join();
+        running = false;
+
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (spill_file) {
+            fclose(spill_file);
+            spill_file = nullptr;
+        }
+    }
+
+    // Для производителей. false - замер потерян
+    bool push(const Sample& sample) {
+        if (!queue.push(sample) && !pushFull(sample)) {
+            return false;
+        }
+
+        accepted.fetch_add(1, std::memory_order_relaxed);
+        wakeWriter();
+        return true;
+    }
+
+    // Закрытые интервалы редки, очередь для них без ограничения
+    void pushBucket(const ClosedBucket& closed) {
+        {
+            std::lock_guard<std::mutex> lock(bucket_mutex);
+            buckets.push_back(closed);
+            buckets_pending = true;
+        }
+        wakeWriter();
+    }
+
+    Stats stats() const {
+        Stats result;
+        result.depth = queue.size();
+        result.max_depth = max_depth.load(std::memory_order_relaxed);
+        result.accepted = accepted.load(std::memory_order_relaxed);
+        result.written = written.load(std::memory_order_relaxed);
+        result.dropped = dropped.load(std::memory_order_relaxed);
+        result.spilled = spilled.load(std::memory_order_relaxed);
+        result.blocked = blocked.load(std::memory_order_relaxed);
+        result.failed_batches = failed_batches.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    // Очередь полна - поступаем по политике. Замер, ушедший в файл,
+    // тоже считается принятым
+    bool pushFull(const Sample& sample) {
+        switch (policy) {
+        case BACKPRESSURE_DROP_OLDEST:
+            for (;;) {
+                Sample oldest;
+                if (queue.pop(oldest)) dropped.fetch_add(1, std::memory_order_relaxed);
+                if (queue.push(sample)) return true;
+            }
+
+        case BACKPRESSURE_SPILL:
+            if (spill(sample)) {
+                spilled.fetch_add(1, std::memory_order_relaxed);
+                wakeWriter();
+                return true;
+            }
+            break;
+
+        case BACKPRESSURE_BLOCK:
+            blocked.fetch_add(1, std::memory_order_relaxed);
+            do {
+                // Поток записи уже остановлен - ждать некого
+                if (!running || stopping) break;
+
+                wakeWriter();
+                std::unique_lock<std::mutex> lock(space_mutex);
+                space_freed.wait_for(lock, std::chrono::milliseconds(WRITE_BLOCK_WAIT_MS));
+                lock.unlock();
+
+                if (queue.push(sample)) return true;
+            } while (true);
+            break;
+        }
+
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Будим поток записи, только если он спит: при потоке замеров
+    // он занят транзакцией, и производитель мьютекс не трогает
+    void wakeWriter() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (writer_idle.load()) {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            wakeup.notify_one();
+        }
+    }
+
+    void writerLoop() {
+        std::vector<Sample> batch;
+        batch.reserve(WRITE_BATCH_MAX);
+        auto last_report = std::chrono::steady_clock::now();
+        Stats reported = stats();
+
+        for (;;) {
+            size_t depth = queue.size();
+            if (depth > max_depth.load(std::memory_order_relaxed)) {
+                max_depth.store(depth, std::memory_order_relaxed);
+            }
+
+            batch.clear();
+            Sample sample;
+            while (batch.size() < WRITE_BATCH_MAX && queue.pop(sample)) {
+                batch.push_back(sample);
+            }
+
+            // Свежие замеры важнее, файл переполнения дописываем в паузах
+            bool replayed = false;
+            if (batch.empty()) {
+                replayBatch(batch);
+                replayed = !batch.empty();
+            }
+
+            if (!batch.empty()) {
+                write(batch, replayed);
+                space_freed.notify_all();
+            }
+
+            if (buckets_pending) writeBuckets();
+
+            if (!batch.empty()) {
+                if (std::chrono::steady_clock::now() - last_report >= std::chrono::seconds(WRITE_REPORT_SEC)) {
+                    last_report = std::chrono::steady_clock::now();
+                    report(reported);
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            if (stopping && !replay_file && !spill_pending && !buckets_pending) break;
+
+            writer_idle.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (queue.empty() && !replay_file && !spill_pending && !buckets_pending && !stopping) {
+                wakeup.wait_for(lock, std::chrono::milliseconds(WRITE_IDLE_WAIT_MS));
+            }
+            writer_idle.store(false);
+        }
+
+        report(reported);
+    }
+
+    // Занятая база (SQLITE_BUSY, диск) часто отпускает через несколько
+    // миллисекунд - повторяем с паузой. Не вышло - откладываем пачку в файл
+    // переполнения. Пачку из самого файла не откладываем: она осталась бы
+    // там навсегда, если база не принимает ее вовсе
+    void write(const std::vector<Sample>& batch, bool replayed) {
+        int wait_ms = WRITE_RETRY_WAIT_MS;
+        for (int attempt = 0; ; ++attempt) {
+            if (db.insertSamples(batch)) {
+                written.fetch_add(batch.size(), std::memory_order_relaxed);
+                return;
+            }
+            if (attempt == WRITE_RETRY_COUNT) break;
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+            wait_ms *= 2;
+        }
+
+        failed_batches.fetch_add(1, std::memory_order_relaxed);
+        if (replayed || !deferBatch(batch)) {
+            dropped.fetch_add(batch.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void writeBuckets() {
+        std::vector<ClosedBucket> closed;
+        {
+            std::lock_guard<std::mutex> lock(bucket_mutex);
+            closed.swap(buckets);
+            buckets_pending = false;
+        }
+        for (const auto& item : closed) {
+            if (bucket_handler) bucket_handler(item);
+        }
+    }
+
+    // О потерях и ожиданиях сообщаем, только если они были с прошлого раза
+    void report(Stats& reported) {
+        Stats current = stats();
+        if (current.dropped != reported.dropped || current.spilled != reported.spilled ||
+            current.blocked != reported.blocked || current.failed_batches != reported.failed_batches) {
+            std::cerr << "Write queue: depth " << current.depth << " (max " << current.max_depth
+                      << "), dropped " << current.dropped << ", spilled " << current.spilled
+                      << ", producer waits " << current.blocked << ", failed batches "
+                      << current.failed_batches << "\n";
+        }
+        reported = current;
+    }
+
+    // Дописываем замер в конец файла переполнения (формат - массив Sample)
+    bool spill(const Sample& sample) {
+        if (spill_path.empty()) return false;
+
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (!spill_file) {
+            spill_file = fopen(spill_path.c_str(), "ab");
+            if (!spill_file) return false;
+        }
+
+        if (fwrite(&sample, sizeof(sample), 1, spill_file) != 1) return false;
+        spill_pending = true;
+        return true;
+    }
+
+    // Пачка, которую база не приняла, ждет в файле переполнения. spill_pending
+    // не ставим: повтор будет при следующем переполнении или запуске, а не сразу
+    bool deferBatch(const std::vector<Sample>& batch) {
+        if (spill_path.empty()) return false;
+
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (!spill_file) {
+            spill_file = fopen(spill_path.c_str(), "ab");
+            if (!spill_file) return false;
+        }
+
+        return fwrite(batch.data(), sizeof(Sample), batch.size(), spill_file) == batch.size();
+    }
+
+    // Очередная пачка из файла переполнения. Накопленный файл переименовывается
+    // и читается по частям, а производители тем временем пишут в новый
+    void replayBatch(std::vector<Sample>& batch) {
+        if (!replay_file) {
+            if (!spill_pending) return;
+
+            std::lock_guard<std::mutex> lock(spill_mutex);
+            if (spill_file) {
+                fclose(spill_file);
+                spill_file = nullptr;
+            }
+            spill_pending = false;
+
+            if (rename(spill_path.c_str(), replayPath().c_str()) != 0) return;
+            replay_file = fopen(replayPath().c_str(), "rb");
+            if (!replay_file) return;
+        }
+
+        batch.resize(WRITE_BATCH_MAX);
+        size_t count = fread(batch.data(), sizeof(Sample), batch.size(), replay_file);
+        batch.resize(count);
+
+        if (count == 0) {
+            fclose(replay_file);
+            replay_file = nullptr;
+            remove(replayPath().c_str());
+        }
+    }
+
+    std::string replayPath() const { return spill_path + ".replay"; }
+
+    Database& db;
+    SampleQueue queue;
+    Backpressure policy;
+    std::string spill_path;
+
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    std::atomic<bool> writer_idle;
+    std::thread worker;
+
+    std::mutex wake_mutex;
+    std::condition_variable wakeup;
+    std::mutex space_mutex;
+    std::condition_variable space_freed;
+
+    // spill_file - под spill_mutex, replay_file трогает только поток записи
+    std::mutex spill_mutex;
+    FILE* spill_file;
+    FILE* replay_file;
+    std::atomic<bool> spill_pending;
+
+    // Закрытые интервалы - под bucket_mutex
+    std::mutex bucket_mutex;
+    std::vector<ClosedBucket> buckets;
+    std::atomic<bool> buckets_pending;
+    BucketHandler bucket_handler;
+
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> spilled;
+    std::atomic<uint64_t> blocked;
+    std::atomic<uint64_t> failed_batches;
+    std::atomic<size_t> max_depth;
+
+    SampleWriter(const SampleWriter&);
+    SampleWriter& operator=(const SampleWriter&);
+};
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef SERIAL_REACTOR_HPP
+#define SERIAL_REACTOR_HPP
+
+#include "my_serial.hpp"
+#include "line_framer.hpp"
+
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#if defined (WIN32)
+#   include <thread>
+#   include <chrono>
+#else
+#   include <sys/epoll.h>
+#   include <unistd.h>
+#   include <cerrno>
+#endif
+
+#define REACTOR_MAX_EVENTS 128          // событий за один epoll_wait
+#define REACTOR_FRAMER_CAPACITY 8192    // буфер строк порта: строки замеров короткие
+#define REACTOR_IDLE_SLEEP_MS 10        // Windows: пауза после круга без новых строк
+
+// Один поток обслуживает сколько угодно портов. Дескрипторы неблокирующих
+// портов лежат в одном наборе epoll, у каждого порта свой LineFramer, а
+// целые строки отдаются обработчику этого порта. За одно пробуждение из
+// каждого готового порта читается не больше одного буфера, поэтому
+// быстрый порт не задерживает остальные.
+//
+//     SerialReactor reactor;
+//     port.SetNonBlocking(true);
+//     reactor.add(port, [](std::string_view line) { ... });
+//     while (running) reactor.poll(100);
+//
+// В Windows epoll нет: порты читаются по очереди без ожидания (нулевой
+// таймаут ReadFile), а круг, не давший строк, заканчивается короткой паузой.
+// Молчащий порт так не задерживает остальные
+class SerialReactor {
+public:
+    // Строка действительна только во время вызова
+    typedef std::function<void(std::string_view line)> LineHandler;
+
+    // Чтение не удалось или устройство отключилось. Порт к этому моменту
+    // уже снят с ожидания, вернуть его - resume()
+    typedef std::function<void()> ErrorHandler;
+
+    explicit SerialReactor(size_t framer_capacity = REACTOR_FRAMER_CAPACITY)
+        : epoll_fd(-1), framer_capacity(framer_capacity) {
+#if !defined (WIN32)
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    }
+
+    ~SerialReactor() {
+        clear();
+#if !defined (WIN32)
+        if (epoll_fd >= 0) ::close(epoll_fd);
+#endif
+    }
+
+    bool isValid() const {
+#if defined (WIN32)
+        return true;
+#else
+        return epoll_fd >= 0;
+#endif
+    }
+
+    // Порт уже открыт и переведен в неблокирующий режим, живет дольше, чем
+    // он зарегистрирован здесь (в Windows ему ставится нулевой таймаут).
+    // Возвращает номер порта в реакторе, -1 - ошибка
+    int add(cplib::SerialPort& port, LineHandler on_line, ErrorHandler on_error = ErrorHandler()) {
+        if (!isValid() || !port.IsOpen()) return -1;
+#if defined (WIN32)
+        if (port.SetTimeout(0) != cplib::SerialPort::RE_OK) return -1;
+#endif
+
+        int id = static_cast<int>(entries.size());
+        entries.emplace_back(new Entry(port, on_line, on_error, framer_capacity));
+        if (!resume(id)) {
+            entries.pop_back();
+            return -1;
+        }
+        return id;
+    }
+
+    // Снять порт с ожидания, буфер неполной строки сохраняется
+    bool suspend(int id) {
+        if (!valid(id)) return false;
+
+        Entry& entry = *entries[id];
+        if (!entry.watched) return true;
+#if !defined (WIN32)
+        // Закрытый дескриптор epoll убирает сам, ошибку тогда не считаем
+        if (entry.port->IsOpen() &&
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, entry.port->GetHandle(), nullptr) != 0) {
+            return false;
+        }
+#endif
+        entry.watched = false;
+        return true;
+    }
+
+    // Вернуть порт в ожидание (после add() он уже ждется)
+    bool resume(int id) {
+        if (!valid(id)) return false;
+
+        Entry& entry = *entries[id];
+        if (entry.watched) return true;
+        if (!entry.port->IsOpen()) return false;
+#if !defined (WIN32)
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = static_cast<uint64_t>(id);
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, entry.port->GetHandle(), &event) != 0) return false;
+#endif
+        entry.watched = true;
+        return true;
+    }
+
+    // Снять все порты. Сами порты не закрываются
+    void clear() {
+        for (size_t id = 0; id < entries.size(); ++id) suspend(static_cast<int>(id));
+        entries.clear();
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // Ждем готовности портов не дольше timeout_ms, читаем готовые и
+    // раздаем строки обработчикам. Возвращает число строк, -1 - ошибка epoll
+    int poll(int timeout_ms) {
+        int lines = 0;
+#if defined (WIN32)
+        for (size_t id = 0; id < entries.size(); ++id) {
+            lines += readPort(static_cast<int>(id), false);
+        }
+        if (lines == 0 && timeout_ms > 0) {
+            int pause_ms = timeout_ms < REACTOR_IDLE_SLEEP_MS ? timeout_ms : REACTOR_IDLE_SLEEP_MS;
+            std::this_thread::sleep_for(std::chrono::milliseconds(pause_ms));
+        }
+#else
+        struct epoll_event events[REACTOR_MAX_EVENTS];
+        int count = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, timeout_ms);
+        if (count < 0) return errno == EINTR ? 0 : -1;
+
+        for (int i = 0; i < count; ++i) {
+            bool hangup = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+            lines += readPort(static_cast<int>(events[i].data.u64), hangup);
+        }
+#endif
+        return lines;
+    }
+
+private:
+    struct Entry {
+        cplib::SerialPort* port;
+        LineHandler on_line;
+        ErrorHandler on_error;
+        LineFramer framer;
+        bool watched;
+
+        Entry(cplib::SerialPort& port, const LineHandler& on_line, const ErrorHandler& on_error,
+              size_t framer_capacity)
+            : port(&port), on_line(on_line), on_error(on_error),
+              framer(framer_capacity), watched(false) {}
+    };
+
+    bool valid(int id) const {
+        return id >= 0 && static_cast<size_t>(id) < entries.size();
+    }
+
+    // Одно чтение из порта. Обработчик может снять с ожидания любой порт,
+    // в том числе тот, событие которого еще не разобрано в этом poll()
+    int readPort(int id, bool hangup) {
+        Entry& entry = *entries[id];
+        if (!entry.watched) return 0;
+
+        size_t bytes_read = 0;
+        int result = entry.port->Read(entry.framer.writePtr(), entry.framer.writable(), &bytes_read);
+
+        // Отключенное устройство: данных нет, а epoll будит снова и снова
+        if (result != cplib::SerialPort::RE_OK || (hangup && bytes_read == 0)) {
+            suspend(id);
+            if (entry.on_error) entry.on_error();
+            return 0;
+        }
+
+        entry.framer.commit(bytes_read);
+
+        int lines = 0;
+        std::string_view line;
+        while (entry.framer.next(line)) {
+            entry.on_line(line);
+            ++lines;
+        }
+        return lines;
+    }
+
+    int epoll_fd;
+    size_t framer_capacity;
+    std::vector<std::unique_ptr<Entry>> entries;
+
+    SerialReactor(const SerialReactor&);
+    SerialReactor& operator=(const SerialReactor&);
+};
+
+#endif
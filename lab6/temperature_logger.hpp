@@ -3,14 +3,23 @@
 
 #include "database.hpp"
 #include "my_serial.hpp"
+#include "serial_reactor.hpp"
+#include "sample_ring.hpp"
+#include "aggregator.hpp"
+#include "sample_parser.hpp"
+#include "retention.hpp"
+#include "sample_writer.hpp"
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <memory>
 #include <atomic>
 #include <mutex>
 #include <thread>
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -19,275 +28,315 @@
 
 
 class TemperatureLogger {
+public:
+    // Датчик: номер, под которым пишутся его замеры, и порт, с которого он читается
+    struct SensorConfig {
+        uint32_t sensor_id;
+        std::string port_name;
+    };
+    
+    // Вызывается из потока записи, когда закрытый час или сутки датчика уже в базе
+    typedef std::function<void(uint32_t, BucketAggregator::Period, const BucketAggregator::Bucket&)> BucketListener;
+    
+    // Вызывается из потока чтения для каждого принятого замера, не должен блокироваться
+    typedef std::function<void(const Sample&)> SampleListener;
+    
 private:
+    // Ожидание данных в портах. Запись в базу идет в своем потоке,
+    // поэтому ждать можно долго: дедлайнов пачки у потока чтения нет
+    static const int IDLE_WAIT_MS = 100;
+    
+    // Порт, чтение из которого не удалось, пропускается столько времени
+    static const int PORT_RETRY_MS = 100;
+    
+    // Порт одного датчика и его открытые интервалы. Порт трогает только
+    // поток чтения, накопители - под data_mutex. *_closed_ms - до какого
+    // момента интервалы были записаны к концу восстановления
+    struct SensorPort {
+        uint32_t sensor_id;
+        cplib::SerialPort port;
+        int reactor_id;
+        SampleRing* recent;
+        BucketAggregator hourly_aggregator;
+        BucketAggregator daily_aggregator;
+        int64_t hour_closed_ms;
+        int64_t day_closed_ms;
+        bool failed;
+        bool failure_reported;      // об отказе уже сообщили, повторы молча
+        std::chrono::steady_clock::time_point retry_at;
+        
+        SensorPort(uint32_t sensor_id, SampleRing* recent)
+            : sensor_id(sensor_id), reactor_id(-1), recent(recent),
+              hourly_aggregator(BucketAggregator::PERIOD_HOUR),
+              daily_aggregator(BucketAggregator::PERIOD_DAY),
+              hour_closed_ms(0), day_closed_ms(0), failed(false), failure_reported(false) {}
+    };
+    
     Database db;
-    cplib::SerialPort* serial_port;
+    
+    // Все порты обслуживает один поток чтения через общий набор epoll,
+    // поэтому потоков не больше при любом числе датчиков
+    std::vector<std::unique_ptr<SensorPort>> sensors;
+    SerialReactor reactor;
     
     std::atomic<bool> running;
     std::thread read_thread;
     std::mutex data_mutex;
     
-    // Буферы для расчета средних
-    std::vector<Database::TemperatureRecord> hourly_buffer;
-    std::map<std::string, std::vector<double>> daily_buffer;
+    // Последние замеры каждого датчика для быстрых ответов HTTP без обращения к базе
+    SampleRings recent_samples;
+    
+    BucketListener bucket_listener;
+    SampleListener sample_listener;
+    
+    // Замеры и закрытые интервалы уходят в базу через очереди и поток
+    // записи: задержки SQLite не доходят до порта
+    SampleWriter writer;
     
-    time_t last_hour_check;
-    time_t last_day_check;
-    time_t last_cleanup_check;
+    // Очистка старых замеров в своем потоке, поток чтения на нее не тратится
+    RetentionWorker retention;
     
-    bool parse_json(const std::string& json_str, Database::TemperatureRecord& record) {
-        size_t temp_pos = json_str.find("\"temperature\":");
-        size_t checksum_pos = json_str.find("\"checksum\":");
-        size_t time_pos = json_str.find("\"timestamp\":");
+    // Учитываем замер в открытых часе и сутках датчика, закрытые интервалы отдаем на запись
+    void aggregate(SensorPort& sensor, int64_t ts_ms, double temperature) {
+        std::lock_guard<std::mutex> lock(data_mutex);
+        BucketAggregator::Bucket closed;
         
-        if (temp_pos == std::string::npos || checksum_pos == std::string::npos || time_pos == std::string::npos) {
-            temp_pos = json_str.find("\"temp\":");
-            checksum_pos = json_str.find("\"chk\":");
-            time_pos = json_str.find("\"time\":");
-            
-            if (temp_pos == std::string::npos || checksum_pos == std::string::npos || time_pos == std::string::npos) {
-                std::cerr << "Invalid JSON\n";
-                return false;
-            }
-            
-            temp_pos += 7;
-            checksum_pos += 7;
-            time_pos += 7;
-        } else {
-            temp_pos += 14;
-            checksum_pos += 11;
-            time_pos += 13;
+        if (sensor.hourly_aggregator.add(ts_ms, temperature, closed)) {
+            closeBucket(sensor.sensor_id, BucketAggregator::PERIOD_HOUR, closed);
         }
-        
-        size_t temp_end = json_str.find_first_of(",}", temp_pos);
-        if (temp_end == std::string::npos) return false;
-        
-        std::string temp_str = json_str.substr(temp_pos, temp_end - temp_pos);
-        double temperature;
-        try {
-            temperature = std::stod(temp_str);
-        } catch (...) {
-            std::cerr << "Failed to parse temperature\n";
-            return false;
+        if (sensor.daily_aggregator.add(ts_ms, temperature, closed)) {
+            closeBucket(sensor.sensor_id, BucketAggregator::PERIOD_DAY, closed);
         }
+    }
+    
+    // Закрываем интервалы, время которых вышло, даже если замеров больше нет
+    void closeExpiredBuckets(int64_t now_ms) {
+        std::lock_guard<std::mutex> lock(data_mutex);
+        BucketAggregator::Bucket closed;
         
-        size_t checksum_end = json_str.find_first_of(",}", checksum_pos);
-        if (checksum_end == std::string::npos) return false;
-        
-        std::string checksum_str = json_str.substr(checksum_pos, checksum_end - checksum_pos);
-        double checksum;
-        try {
-            checksum = std::stod(checksum_str);
-        } catch (...) {
-            std::cerr << "Failed to parse checksum\n";
-            return false;
+        for (auto& sensor : sensors) {
+            if (sensor->hourly_aggregator.closeExpired(now_ms, closed)) {
+                closeBucket(sensor->sensor_id, BucketAggregator::PERIOD_HOUR, closed);
+            }
+            if (sensor->daily_aggregator.closeExpired(now_ms, closed)) {
+                closeBucket(sensor->sensor_id, BucketAggregator::PERIOD_DAY, closed);
+            }
         }
+    }
+    
+    // Под data_mutex на потоке чтения: строку запишет поток записи
+    void closeBucket(uint32_t sensor_id, BucketAggregator::Period period, const BucketAggregator::Bucket& bucket) {
+        SampleWriter::ClosedBucket closed = { sensor_id, period, bucket };
+        writer.pushBucket(closed);
+    }
+    
+    // Строка часа или суток в базе, затем слушатель. Из потока записи
+    // (при восстановлении - из start(), пока потоков еще нет)
+    void storeBucket(const SampleWriter::ClosedBucket& closed) {
+        bool stored = closed.period == BucketAggregator::PERIOD_HOUR
+            ? processHourlyBucket(closed.sensor_id, closed.bucket)
+            : processDailyBucket(closed.sensor_id, closed.bucket);
         
-        const double EPSILON = 0.01;
-        if (std::fabs(temperature - checksum) > EPSILON) {
-            std::cerr << "Checksum error\n";
-            return false;
-        }
+        if (stored && bucket_listener) bucket_listener(closed.sensor_id, closed.period, closed.bucket);
+    }
+    
+    bool processHourlyBucket(uint32_t sensor_id, const BucketAggregator::Bucket& bucket) {
+        if (bucket.acc.empty()) return true;
         
-        size_t time_end = json_str.find('"', time_pos + 1);
-        if (time_end == std::string::npos) {
-            time_end = json_str.find_first_of(",}", time_pos);
-            if (time_end == std::string::npos) return false;
-            record.timestamp = json_str.substr(time_pos, time_end - time_pos);
-        } else {
-            record.timestamp = json_str.substr(time_pos + 1, time_end - time_pos - 1);
+        if (!db.insertHourlyAverage(formatHourMs(bucket.start_ms), bucket.acc.average(),
+                                    bucket.acc.min, bucket.acc.max, bucket.acc.count, sensor_id)) {
+            std::cerr << "Failed to write hourly average for sensor " << sensor_id << "\n";
+            return false;
         }
         
-        record.temperature = temperature;
-        
-        if (record.timestamp.length() >= 10) {
-            record.date = record.timestamp.substr(0, 10);
-        } else {
-            time_t now = time(nullptr);
-            struct tm* tm_info = localtime(&now);
-            char date_buffer[11];
-            strftime(date_buffer, sizeof(date_buffer), "%Y-%m-%d", tm_info);
-            record.date = date_buffer;
-        }
+        std::cout << "Hourly average calculated for sensor " << sensor_id
+                  << " (stddev " << bucket.acc.stddev() << ")\n";
+        return true;
+    }
+    
+    bool processDailyBucket(uint32_t sensor_id, const BucketAggregator::Bucket& bucket) {
+        if (bucket.acc.empty()) return true;
         
-        if (record.timestamp.length() >= 13) {
-            record.hour = record.timestamp.substr(0, 13) + ":00:00.000";
-        } else {
-            time_t now = time(nullptr);
-            struct tm* tm_info = localtime(&now);
-            char hour_buffer[14];
-            strftime(hour_buffer, sizeof(hour_buffer), "%Y-%m-%d %H:00:00.000", tm_info);
-            record.hour = hour_buffer;
+        if (!db.insertDailyAverage(formatDateMs(bucket.start_ms), bucket.acc.average(),
+                                   bucket.acc.min, bucket.acc.max, bucket.acc.count, sensor_id)) {
+            std::cerr << "Failed to write daily average for sensor " << sensor_id << "\n";
+            return false;
         }
         
+        std::cout << "Daily average calculated for sensor " << sensor_id
+                  << " (stddev " << bucket.acc.stddev() << ")\n";
         return true;
     }
     
-    void processHourlyBuffer() {
-        std::lock_guard<std::mutex> lock(data_mutex);
+    // Восстановление после перезапуска (в том числе после падения):
+    // открытые час и сутки заново набираются из минутных сводок базы, а
+    // закрытые за это время интервалы записываются. Берутся сутки последнего
+    // замера и предыдущие - не больше 2880 строк на датчик, temperature_raw не читается
+    void recoverBuckets(SensorPort& sensor) {
+        int64_t last_minute;
+        if (!db.getLastRollupMinute(last_minute, sensor.sensor_id)) return;
         
-        if (hourly_buffer.empty()) return;
+        int64_t from_ms = localDayFloorMs(localDayFloorMs(last_minute) - 1);
+        std::vector<Database::RollupBucket> minutes =
+            db.getMinuteRollups(from_ms, last_minute + MS_PER_MINUTE, sensor.sensor_id);
         
-        std::map<std::string, std::vector<double>> hourly_data;
-        for (const auto& record : hourly_buffer) {
-            hourly_data[record.hour].push_back(record.temperature);
-        }
+        // Потока записи еще нет: закрытые интервалы пишем сразу
+        std::lock_guard<std::mutex> lock(data_mutex);
+        SampleWriter::ClosedBucket closed;
+        closed.sensor_id = sensor.sensor_id;
         
-        for (const auto& pair : hourly_data) {
-            const std::string& hour = pair.first;
-            const std::vector<double>& temps = pair.second;
-            
-            if (temps.empty()) continue;
-            
-            double sum = 0;
-            double min_temp = temps[0];
-            double max_temp = temps[0];
-            
-            for (double temp : temps) {
-                sum += temp;
-                if (temp < min_temp) min_temp = temp;
-                if (temp > max_temp) max_temp = temp;
+        for (const auto& minute : minutes) {
+            if (sensor.hourly_aggregator.add(minute.start_ms, minute.totals, closed.bucket)) {
+                closed.period = BucketAggregator::PERIOD_HOUR;
+                storeBucket(closed);
+            }
+            if (sensor.daily_aggregator.add(minute.start_ms, minute.totals, closed.bucket)) {
+                closed.period = BucketAggregator::PERIOD_DAY;
+                storeBucket(closed);
             }
-            
-            double avg_temp = sum / temps.size();
-            db.insertHourlyAverage(hour, avg_temp, min_temp, max_temp, temps.size());
-            
-            std::cout << "Hourly average calculated\n";
         }
+        sensor.hour_closed_ms = sensor.hourly_aggregator.openBucket().start_ms;
+        sensor.day_closed_ms = sensor.daily_aggregator.openBucket().start_ms;
         
-        hourly_buffer.clear();
+        std::cout << "Recovered open buckets of sensor " << sensor.sensor_id << " from "
+                  << minutes.size() << " minute rollups\n";
     }
     
-    void processDailyBuffer() {
-        std::lock_guard<std::mutex> lock(data_mutex);
-        
-        if (daily_buffer.empty()) return;
+    // Строка, которую реактор собрал из порта датчика
+    void handleLine(SensorPort& sensor, std::string_view line) {
+        if (sensor.failure_reported) {
+            std::cout << "Sensor " << sensor.sensor_id << " is readable again\n";
+            sensor.failure_reported = false;
+        }
         
-        for (const auto& pair : daily_buffer) {
-            const std::string& date = pair.first;
-            const std::vector<double>& temps = pair.second;
-            
-            if (temps.empty()) continue;
-            
-            double sum = 0;
-            double min_temp = temps[0];
-            double max_temp = temps[0];
-            
-            for (double temp : temps) {
-                sum += temp;
-                if (temp < min_temp) min_temp = temp;
-                if (temp > max_temp) max_temp = temp;
+        Sample sample;
+        SampleParseResult parsed = parseSample(line, currentTimeMs(), sample);
+        if (parsed == PARSE_OK) {
+            sample.sensor_id = sensor.sensor_id;
+            sensor.recent->push(sample);
+            if (sample_listener) sample_listener(sample);
+            aggregate(sensor, sample.ts_ms, sample.value);
+            writer.push(sample);
+        } else {
+            std::cerr << sampleParseError(parsed) << "\n";
+        }
+    }
+    
+    // Реактор уже снял порт с ожидания. Остальные порты читаем дальше,
+    // этот вернем через PORT_RETRY_MS. Отключенный порт отказывает на
+    // каждом повторе - сообщаем один раз, до следующей принятой строки
+    void portFailed(SensorPort& sensor) {
+        if (!sensor.failure_reported) {
+            std::cerr << "Failed to read sensor " << sensor.sensor_id << "\n";
+            sensor.failure_reported = true;
+        }
+        sensor.failed = true;
+        sensor.retry_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(PORT_RETRY_MS);
+    }
+    
+    void retryFailedPorts() {
+        auto now = std::chrono::steady_clock::now();
+        for (auto& sensor : sensors) {
+            if (sensor->failed && now >= sensor->retry_at && reactor.resume(sensor->reactor_id)) {
+                sensor->failed = false;
             }
-            
-            double avg_temp = sum / temps.size();
-            db.insertDailyAverage(date, avg_temp, min_temp, max_temp, temps.size());
-            
-            std::cout << "Daily average calculated\n";
         }
-        
-        daily_buffer.clear();
     }
     
-    void cleanupOldData() {
-        db.cleanupOldData(30);
+    void closePorts() {
+        reactor.clear();
+        for (auto& sensor : sensors) {
+            if (sensor->port.IsOpen()) sensor->port.Close();
+        }
+        sensors.clear();
     }
     
 public:
-    TemperatureLogger() 
-        : serial_port(nullptr), running(false),
-          last_hour_check(time(nullptr)),
-          last_day_check(time(nullptr)),
-          last_cleanup_check(time(nullptr)) {}
+    TemperatureLogger()
+        : running(false), writer(db), retention(db) {}
     
     ~TemperatureLogger() {
         stop();
     }
     
-    bool initialize(const std::string& db_file, const std::string& port_name) {
+    bool initialize(const std::string& db_file, const std::vector<SensorConfig>& configs) {
+        if (configs.empty()) {
+            std::cerr << "No sensors configured\n";
+            return false;
+        }
+        if (!reactor.isValid()) {
+            std::cerr << "Failed to create port reactor\n";
+            return false;
+        }
+        
         if (!db.open(db_file)) {
             std::cerr << "Failed to open database\n";
             return false;
         }
+        writer.setSpillPath(db_file + "-spill");
+        writer.setBucketHandler([this](const SampleWriter::ClosedBucket& closed) { storeBucket(closed); });
         
-        serial_port = new cplib::SerialPort();
-        cplib::SerialPort::Parameters params("115200");
-        params.timeout = 1.0;
-        
-        int result = serial_port->Open(port_name, params);
-        if (result != cplib::SerialPort::RE_OK) {
-            std::cerr << "Failed to open serial port\n";
-            delete serial_port;
-            serial_port = nullptr;
-            return false;
+        for (const auto& config : configs) {
+            if (recent_samples.find(config.sensor_id)) {
+                std::cerr << "Duplicate sensor id " << config.sensor_id << "\n";
+                closePorts();
+                return false;
+            }
+            
+            std::unique_ptr<SensorPort> sensor(new SensorPort(config.sensor_id,
+                                                              &recent_samples.add(config.sensor_id)));
+            cplib::SerialPort::Parameters params("115200");
+            params.timeout = 1.0;
+            
+            int result = sensor->port.Open(config.port_name, params);
+            if (result == cplib::SerialPort::RE_OK) {
+                // Читаем по готовности порта, а не по таймауту VTIME
+                result = sensor->port.SetNonBlocking(true);
+            }
+            if (result == cplib::SerialPort::RE_OK) {
+                SensorPort* port = sensor.get();
+                sensor->reactor_id = reactor.add(sensor->port,
+                    [this, port](std::string_view line) { handleLine(*port, line); },
+                    [this, port]() { portFailed(*port); });
+                if (sensor->reactor_id < 0) result = cplib::SerialPort::RE_PORT_SYSTEM_ERROR;
+            }
+            if (result != cplib::SerialPort::RE_OK) {
+                std::cerr << "Failed to open serial port " << config.port_name << "\n";
+                closePorts();
+                return false;
+            }
+            
+            db.registerSensor(config.sensor_id, config.port_name);
+            sensors.push_back(std::move(sensor));
         }
-
+        
         return true;
     }
     
+    // Один датчик с номером 0, как до поддержки нескольких портов
+    bool initialize(const std::string& db_file, const std::string& port_name) {
+        SensorConfig config = { 0, port_name };
+        return initialize(db_file, std::vector<SensorConfig>(1, config));
+    }
+    
     void start() {
         if (running) return;
         
         running = true;
         
+        // До первого замера: новые замеры должны попасть в уже восстановленные интервалы
+        for (auto& sensor : sensors) recoverBuckets(*sensor);
+        writer.start();
+        retention.start();
+        
         read_thread = std::thread([this]() {
-            std::string buffer;
-            char read_buf[1024];
-            
             while (running) {
-                size_t bytes_read = 0;
-                int result = serial_port->Read(read_buf, sizeof(read_buf) - 1, &bytes_read);
-                
-                if (result == cplib::SerialPort::RE_OK && bytes_read > 0) {
-                    read_buf[bytes_read] = '\0';
-                    buffer += read_buf;
-                    
-                    size_t pos = 0;
-                    while ((pos = buffer.find('\n')) != std::string::npos) {
-                        std::string line = buffer.substr(0, pos);
-                        buffer.erase(0, pos + 1);
-                        
-                        while (!line.empty() && (line[0] == '\r' || line[0] == '\n' || line[0] == ' ' || line[0] == '\t')) {
-                            line.erase(0, 1);
-                        }
-                        
-                        if (line.empty()) continue;
-                        
-                        Database::TemperatureRecord record;
-                        if (parse_json(line, record)) {
-                            if (db.insertRawData(record)) {
-                                {
-                                    std::lock_guard<std::mutex> lock(data_mutex);
-                                    hourly_buffer.push_back(record);
-                                    daily_buffer[record.date].push_back(record.temperature);
-                                }
-                                std::cout << "Data received\n";
-                            }
-                        } else {
-                            std::cerr << "Failed to parse JSON\n";
-                        }
-                    }
-                } else if (result != cplib::SerialPort::RE_OK) {
+                if (reactor.poll(IDLE_WAIT_MS) < 0) {
                     std::this_thread::sleep_for(std::chrono::milliseconds(100));
                 }
                 
-                time_t current_time = time(nullptr);
-                
-                if (difftime(current_time, last_hour_check) >= 60 * 60) {
-                    processHourlyBuffer();
-                    last_hour_check = current_time;
-                }
-                
-                if (difftime(current_time, last_day_check) >= 24 * 60 * 60) {
-                    processDailyBuffer();
-                    last_day_check = current_time;
-                }
-                
-                if (difftime(current_time, last_cleanup_check) >= 24 * 60 * 60) {
-                    cleanupOldData();
-                    last_cleanup_check = current_time;
-                }
-                
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                retryFailedPorts();
+                closeExpiredBuckets(currentTimeMs());
             }
         });
     }
@@ -298,27 +347,55 @@ public:
         if (read_thread.joinable()) {
             read_thread.join();
         }
+        // Очередь дописывается до конца, пока база еще открыта
+        writer.stop();
+        retention.stop();
         
-        processHourlyBuffer();
-        processDailyBuffer();
+        // Повторный вызов (из деструктора) - уже остановлены
+        if (sensors.empty()) return;
         
-        if (serial_port) {
-            serial_port->Close();
-            delete serial_port;
-            serial_port = nullptr;
+        // Незакрытые интервалы сохраняем как есть, после перезапуска
+        // recoverBuckets продолжит их и перезапишет полным значением
+        {
+            std::lock_guard<std::mutex> lock(data_mutex);
+            for (auto& sensor : sensors) {
+                processHourlyBucket(sensor->sensor_id, sensor->hourly_aggregator.openBucket());
+                processDailyBucket(sensor->sensor_id, sensor->daily_aggregator.openBucket());
+            }
         }
         
+        closePorts();
         db.close();
     }
     
     // Статистика
-    double getCurrentTemperature() { return db.getCurrentTemperature(); }
-    Database::Statistics getStatistics(const std::string& start, const std::string& end) {
-        return db.getStatistics(start, end);
+    double getCurrentTemperature(uint32_t sensor_id = 0) { return db.getCurrentTemperature(sensor_id); }
+    Database::Statistics getStatistics(const std::string& start, const std::string& end, uint32_t sensor_id = 0) {
+        return db.getStatistics(start, end, sensor_id);
+    }
+    
+    // Задается до start()
+    void setBackpressure(SampleWriter::Backpressure policy) { writer.setBackpressure(policy); }
+    void setBucketListener(BucketListener listener) { bucket_listener = listener; }
+    void setSampleListener(SampleListener listener) { sample_listener = listener; }
+    
+    // До какого момента часы или сутки датчика были закрыты и записаны к
+    // концу восстановления в start(): начало восстановленного открытого
+    // интервала, 0 - замеров у датчика еще не было. О закрытых позже
+    // сообщает BucketListener
+    int64_t closedThrough(uint32_t sensor_id, BucketAggregator::Period period) {
+        std::lock_guard<std::mutex> lock(data_mutex);
+        for (const auto& sensor : sensors) {
+            if (sensor->sensor_id != sensor_id) continue;
+            return period == BucketAggregator::PERIOD_HOUR ? sensor->hour_closed_ms : sensor->day_closed_ms;
+        }
+        return 0;
     }
     
     // Для доступа к базе данных из других компонентов
     Database& getDatabase() { return db; }
+    SampleWriter::Stats getWriteStats() const { return writer.stats(); }
+    const SampleRings& getRecentSamples() const { return recent_samples; }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,6 +3,11 @@
 #include <QGridLayout>
 #include <QMessageBox>
 
+#include <QVector>
+#include <QPointF>
+
+#include "columnar.hpp"
+
 
 #if defined(QT_CHARTS_LIB)
     #if QT_VERSION_MAJOR == 6
@@ -24,6 +29,7 @@ TemperatureMonitorGUI::TemperatureMonitorGUI(QWidget *parent)
     , temperatureChart(nullptr)
     , temperatureSeries(nullptr)
     , avgSeries(nullptr)
+    , streamReply(nullptr)
     , serverUrl("http://localhost:8080")
 {
     setupUI();
@@ -34,17 +40,21 @@ TemperatureMonitorGUI::TemperatureMonitorGUI(QWidget *parent)
     resize(1200, 800);
     setWindowTitle("Мониторинг температуры");
     
-    updateTimer->start(5000); // Обновление каждые 5 секунд
+    updateTimer->start(5000); // Обновление каждые 5 секунд, пока нет потока
     
     // Первоначальное обновление
     updateCurrentTemperature();
     fetchHistoryData();
+    openStream();
 }
 
 TemperatureMonitorGUI::~TemperatureMonitorGUI() {
     if (updateTimer) {
         updateTimer->stop();
     }
+    
+    // Обрыв потока при закрытии не должен планировать переподключение
+    networkManager->disconnect(this);
 }
 
 void TemperatureMonitorGUI::setupUI() {
@@ -227,9 +237,7 @@ void TemperatureMonitorGUI::setupCharts() {
 
 // Запросы к апи
 void TemperatureMonitorGUI::updateCurrentTemperature() {
-    QUrl url(serverUrl + "/api/current");
-    QNetworkRequest request(url);
-    networkManager->get(request);
+    sendRequest(QUrl(serverUrl + "/api/current"));
 }
 
 void TemperatureMonitorGUI::fetchHistoryData() {
@@ -246,36 +254,120 @@ void TemperatureMonitorGUI::fetchHistoryData() {
     QString startStr = startDateTime.toString("yyyy-MM-dd HH:mm:ss");
     QString endStr = endDateTime.toString("yyyy-MM-dd HH:mm:ss");
     
-    QUrl url(serverUrl + "/api/raw");
+    // Весь диапазон, прореженный сервером до пары точек (минимум и максимум)
+    // на пиксель графика - объем ответа не зависит от длины диапазона.
+    // До первого показа окна ширина виджета еще не настоящая
+    int width = chartView ? chartView->width() : 0;
+    int points = 2 * qMax(width, 800);
+    
+    QUrl url(serverUrl + "/api/series");
     QUrlQuery query;
     query.addQueryItem("start", startStr);
     query.addQueryItem("end", endStr);
-    query.addQueryItem("limit", "1000");
+    query.addQueryItem("points", QString::number(points));
     url.setQuery(query);
     
+    sendRequest(url);
+}
+
+// GET с тегом прошлого ответа на тот же URL
+void TemperatureMonitorGUI::sendRequest(const QUrl& url) {
     QNetworkRequest request(url);
+    
+    auto it = etags.constFind(url.toString());
+    if (it != etags.constEnd()) {
+        request.setRawHeader("If-None-Match", it.value());
+    }
+    
+    // Историю просим в колоночном виде: старый сервер ответит JSON
+    if (url.path() == "/api/raw" || url.path() == "/api/series") {
+        request.setRawHeader("Accept", COLUMNAR_CONTENT_TYPE);
+    }
+    
     networkManager->get(request);
 }
 
+// Подписка на новые замеры датчика 0: сервер держит соединение и шлет события SSE
+void TemperatureMonitorGUI::openStream() {
+    if (streamReply) return;
+    
+    QNetworkRequest request(QUrl(serverUrl + "/api/stream?sensor=0"));
+    request.setRawHeader("Accept", "text/event-stream");
+    streamReply = networkManager->get(request);
+    connect(streamReply, &QNetworkReply::readyRead, this, &TemperatureMonitorGUI::onStreamData);
+}
+
+void TemperatureMonitorGUI::onStreamData() {
+    if (!streamReply) return;
+    
+    // Поток пошел - опрашивать больше не нужно
+    if (updateTimer->isActive()) {
+        updateTimer->stop();
+    }
+    
+    streamBuffer += streamReply->readAll();
+    
+    // События разделены пустой строкой, замер - в строке "data: {...}"
+    int end;
+    while ((end = streamBuffer.indexOf("\n\n")) != -1) {
+        QByteArray event = streamBuffer.left(end);
+        streamBuffer.remove(0, end + 2);
+        
+        for (const QByteArray& line : event.split('\n')) {
+            if (line.startsWith("data:")) {
+                parseCurrentTemperature(QJsonDocument::fromJson(line.mid(5)).object());
+            }
+        }
+    }
+    
+    if (streamBuffer.size() > 65536) {
+        streamBuffer.clear();
+    }
+}
+
 void TemperatureMonitorGUI::onDataReceived(QNetworkReply* reply) {
+    // Поток оборвался: возвращаемся к опросу и переподключаемся позже
+    if (reply == streamReply) {
+        streamReply = nullptr;
+        streamBuffer.clear();
+        reply->deleteLater();
+        
+        if (!updateTimer->isActive()) {
+            updateTimer->start(5000);
+        }
+        QTimer::singleShot(5000, this, &TemperatureMonitorGUI::openStream);
+        return;
+    }
+    
     if (reply->error() != QNetworkReply::NoError) {
         QMessageBox::warning(this, "Ошибка", "Не удалось получить данные: " + reply->errorString());
         reply->deleteLater();
         return;
     }
     
-    QByteArray data = reply->readAll();
     QUrl url = reply->url();
     QString path = url.path();
     
-    reply->deleteLater();
+    // Данные не изменились - на экране уже актуальные
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+        reply->deleteLater();
+        return;
+    }
+    
+    QByteArray etag = reply->rawHeader("ETag");
+    if (!etag.isEmpty()) {
+        etags.insert(url.toString(), etag);
+    }
     
-    QJsonDocument doc = QJsonDocument::fromJson(data);
+    QByteArray data = reply->readAll();
+    QString contentType = reply->header(QNetworkRequest::ContentTypeHeader).toString();
+    
+    reply->deleteLater();
     
     if (path.contains("/api/current")) {
-        parseCurrentTemperature(doc.object());
-    } else if (path.contains("/api/raw")) {
-        parseHistoryData(doc.array());
+        parseCurrentTemperature(QJsonDocument::fromJson(data).object());
+    } else if (path.contains("/api/raw") || path.contains("/api/series")) {
+        parseHistoryData(data, contentType.startsWith(COLUMNAR_CONTENT_TYPE));
     }
 }
 
@@ -286,7 +378,7 @@ void TemperatureMonitorGUI::parseCurrentTemperature(const QJsonObject& json) {
     }
 }
 
-void TemperatureMonitorGUI::parseHistoryData(const QJsonArray& array) {
+void TemperatureMonitorGUI::parseHistoryData(const QByteArray& data, bool columnar) {
     #ifdef QT_CHARTS_LIB
     if (temperatureSeries && avgSeries) {
         temperatureSeries->clear();
@@ -294,44 +386,51 @@ void TemperatureMonitorGUI::parseHistoryData(const QJsonArray& array) {
     }
     #endif
     
-    if (array.isEmpty()) {
-        avgTempLabel->setText("Средняя температура: нет данных");
-        return;
-    }
-    
+    // Точки собираем целиком и отдаем графику одним replace
+    QVector<QPointF> points;
     double sum = 0;
-    QDateTime minTime, maxTime;
-    int validCount = 0;
-    
-    for (const QJsonValue& value : array) {
-        QJsonObject obj = value.toObject();
-        QDateTime timestamp = QDateTime::fromString(obj["timestamp"].toString(), 
-                                                   "yyyy-MM-dd HH:mm:ss.zzz");
-        double temperature = obj["temperature"].toDouble();
-        
-        if (timestamp.isValid()) {
-            qint64 ts = timestamp.toMSecsSinceEpoch();
-            
-            #ifdef QT_CHARTS_LIB
-            if (temperatureSeries) {
-                temperatureSeries->append(ts, temperature);
+    qint64 minTs = 0, maxTs = 0;
+    
+    auto addPoint = [&](qint64 ts, double temperature) {
+        if (points.isEmpty() || ts < minTs) minTs = ts;
+        if (points.isEmpty() || ts > maxTs) maxTs = ts;
+        points.append(QPointF(ts, temperature));
+        sum += temperature;
+    };
+    
+    if (columnar) {
+        // Время уже в мс от эпохи - ни разбора JSON, ни разбора дат
+        if (!decodeColumnar(data.constData(), static_cast<size_t>(data.size()),
+                            [&](int64_t ts, float temperature) { addPoint(ts, temperature); })) {
+            points.clear();
+        }
+    } else {
+        const QJsonArray array = QJsonDocument::fromJson(data).array();
+        for (const QJsonValue& value : array) {
+            QJsonObject obj = value.toObject();
+            QDateTime timestamp = QDateTime::fromString(obj["timestamp"].toString(), 
+                                                       "yyyy-MM-dd HH:mm:ss.zzz");
+            if (timestamp.isValid()) {
+                addPoint(timestamp.toMSecsSinceEpoch(), obj["temperature"].toDouble());
             }
-            #endif
-            
-            sum += temperature;
-            validCount++;
-            
-            if (!minTime.isValid() || timestamp < minTime) minTime = timestamp;
-            if (!maxTime.isValid() || timestamp > maxTime) maxTime = timestamp;
         }
     }
     
-    if (validCount == 0) {
+    if (points.isEmpty()) {
         avgTempLabel->setText("Средняя температура: нет данных");
         return;
     }
     
-    double avgTemp = sum / validCount;
+    #ifdef QT_CHARTS_LIB
+    if (temperatureSeries) {
+        temperatureSeries->replace(points);
+    }
+    #endif
+    
+    QDateTime minTime = QDateTime::fromMSecsSinceEpoch(minTs);
+    QDateTime maxTime = QDateTime::fromMSecsSinceEpoch(maxTs);
+    
+    double avgTemp = sum / points.size();
     avgTempLabel->setText(QString("Средняя температура: %1").arg(formatTemperature(avgTemp)));
     
     #ifdef QT_CHARTS_LIB
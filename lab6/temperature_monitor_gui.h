@@ -18,6 +18,7 @@
 #include <QVBoxLayout>
 #include <QGroupBox>
 #include <QPainter>
+#include <QHash>
 
 // Кроссплатформенные заголовки QtCharts
 #if defined(QT_CHARTS_LIB)
@@ -50,13 +51,16 @@ private slots:
     void updateCurrentTemperature();
     void fetchHistoryData();
     void onDataReceived(QNetworkReply* reply);
+    void openStream();
+    void onStreamData();
     
 private:
     void setupUI();
     void setupConnections();
     void setupCharts();
     void parseCurrentTemperature(const QJsonObject& json);
-    void parseHistoryData(const QJsonArray& array);
+    void parseHistoryData(const QByteArray& data, bool columnar);
+    void sendRequest(const QUrl& url);
     QString formatTemperature(double temp) const;
     
     // UI
@@ -80,6 +84,13 @@ private:
     // Сетевой менеджер
     QNetworkAccessManager *networkManager;
     
+    // Подписка на /api/stream. Пока она жива, таймер опроса стоит
+    QNetworkReply *streamReply;
+    QByteArray streamBuffer;
+    
+    // ETag последнего ответа по каждому URL: без изменений сервер отвечает 304
+    QHash<QString, QByteArray> etags;
+    
     // Конфигурация
     QString serverUrl;
 };
@@ -0,0 +1,240 @@
+#ifndef TIME_UTILS_HPP
+#define TIME_UTILS_HPP
+
+#include <string>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+
+// Перевод меток времени "YYYY-MM-DD HH:MM:SS.mmm" (локальное время)
+// в миллисекунды от эпохи и обратно
+
+#define MS_PER_SECOND   1000LL
+#define MS_PER_MINUTE   (60 * MS_PER_SECOND)
+#define MS_PER_HOUR     (60 * MS_PER_MINUTE)
+#define MS_PER_DAY      (24 * MS_PER_HOUR)
+
+inline int64_t currentTimeMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline void localTime(int64_t ms, struct tm& tm_info) {
+    time_t seconds = static_cast<time_t>(ms >= 0 ? ms / 1000 : (ms - 999) / 1000);
+#if defined (WIN32)
+    localtime_s(&tm_info, &seconds);
+#else
+    localtime_r(&seconds, &tm_info);
+#endif
+}
+
+// Начало локального часа в мс. mktime дорогой, поэтому последний час кэшируем
+inline int64_t localHourStartMs(int year, int month, int day, int hour) {
+    struct HourCache {
+        int year, month, day, hour;
+        int64_t start_ms;
+    };
+    thread_local HourCache cache = { -1, -1, -1, -1, 0 };
+
+    if (cache.year != year || cache.month != month || cache.day != day || cache.hour != hour) {
+        struct tm tm_info = {};
+        tm_info.tm_year = year - 1900;
+        tm_info.tm_mon = month - 1;
+        tm_info.tm_mday = day;
+        tm_info.tm_hour = hour;
+        tm_info.tm_isdst = -1;
+        cache.start_ms = static_cast<int64_t>(mktime(&tm_info)) * MS_PER_SECOND;
+        cache.year = year;
+        cache.month = month;
+        cache.day = day;
+        cache.hour = hour;
+    }
+
+    return cache.start_ms;
+}
+
+// Начало локального часа, в который попадает ms
+inline int64_t localHourFloorMs(int64_t ms) {
+    struct tm tm_info;
+    localTime(ms, tm_info);
+    int64_t millis = ((ms % 1000) + 1000) % 1000;
+    return ms - tm_info.tm_min * MS_PER_MINUTE - tm_info.tm_sec * MS_PER_SECOND - millis;
+}
+
+// Локальная полночь суток, в которые попадает ms
+inline int64_t localDayFloorMs(int64_t ms) {
+    struct tm tm_info;
+    localTime(ms, tm_info);
+    tm_info.tm_hour = 0;
+    tm_info.tm_min = 0;
+    tm_info.tm_sec = 0;
+    tm_info.tm_isdst = -1;
+    return static_cast<int64_t>(mktime(&tm_info)) * MS_PER_SECOND;
+}
+
+// Читает ровно count цифр
+inline bool parseDigits(const char*& p, const char* end, int count, int& value) {
+    if (end - p < count) return false;
+    value = 0;
+    for (int i = 0; i < count; ++i, ++p) {
+        if (*p < '0' || *p > '9') return false;
+        value = value * 10 + (*p - '0');
+    }
+    return true;
+}
+
+// Принимает "YYYY-MM-DD", "YYYY-MM-DD HH:MM", "YYYY-MM-DD HH:MM:SS" и
+// "YYYY-MM-DD HH:MM:SS.mmm". Дата и время разделяются пробелом или 'T'
+inline bool parseTimestampMs(const char* str, size_t len, int64_t& ms) {
+    const char* p = str;
+    const char* end = str + len;
+    int year, month, day, hour = 0, minute = 0, second = 0, millis = 0;
+
+    if (!parseDigits(p, end, 4, year) || p == end || *p++ != '-') return false;
+    if (!parseDigits(p, end, 2, month) || p == end || *p++ != '-') return false;
+    if (!parseDigits(p, end, 2, day)) return false;
+
+    if (p != end) {
+        if (*p != ' ' && *p != 'T') return false;
+        ++p;
+
+        if (!parseDigits(p, end, 2, hour)) return false;
+        if (p == end || *p++ != ':' || !parseDigits(p, end, 2, minute)) return false;
+
+        if (p != end) {
+            if (*p++ != ':' || !parseDigits(p, end, 2, second)) return false;
+            if (p != end) {
+                if (*p++ != '.' || !parseDigits(p, end, 3, millis)) return false;
+            }
+        }
+    }
+
+    if (p != end) return false;
+    if (month < 1 || month > 12 || day < 1 || day > 31) return false;
+    if (hour > 23 || minute > 59 || second > 60 || millis > 999) return false;
+
+    ms = localHourStartMs(year, month, day, hour) +
+         minute * MS_PER_MINUTE + second * MS_PER_SECOND + millis;
+    return true;
+}
+
+inline bool parseTimestampMs(const std::string& str, int64_t& ms) {
+    return parseTimestampMs(str.data(), str.size(), ms);
+}
+
+// "YYYY-MM-DD HH:MM:SS.mmm". Внутри одного часа localtime не зовем,
+// а дописываем минуты и секунды к закэшированному префиксу
+inline std::string formatTimestampMs(int64_t ms) {
+    struct PrefixCache {
+        int64_t hour_start_ms;
+        char prefix[64];
+    };
+    thread_local PrefixCache cache = { -1, "" };
+
+    if (cache.hour_start_ms < 0 || ms < cache.hour_start_ms || ms >= cache.hour_start_ms + MS_PER_HOUR) {
+        struct tm tm_info;
+        localTime(ms, tm_info);
+        int millis = static_cast<int>(((ms % 1000) + 1000) % 1000);
+        cache.hour_start_ms = ms - tm_info.tm_min * MS_PER_MINUTE - tm_info.tm_sec * MS_PER_SECOND - millis;
+        snprintf(cache.prefix, sizeof(cache.prefix), "%04d-%02d-%02d %02d:",
+                 tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday, tm_info.tm_hour);
+    }
+
+    int64_t offset = ms - cache.hour_start_ms;
+    char buffer[96];
+    snprintf(buffer, sizeof(buffer), "%s%02d:%02d.%03d", cache.prefix,
+             static_cast<int>(offset / MS_PER_MINUTE),
+             static_cast<int>(offset / MS_PER_SECOND % 60),
+             static_cast<int>(offset % 1000));
+    return buffer;
+}
+
+// "YYYY-MM-DD"
+inline std::string formatDateMs(int64_t ms) {
+    struct tm tm_info;
+    localTime(ms, tm_info);
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d",
+             tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday);
+    return buffer;
+}
+
+// "YYYY-MM-DD HH:00:00.000" - ключ часовых средних
+inline std::string formatHourMs(int64_t ms) {
+    struct tm tm_info;
+    localTime(ms, tm_info);
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:00:00.000",
+             tm_info.tm_year + 1900, tm_info.tm_mon + 1, tm_info.tm_mday, tm_info.tm_hour);
+    return buffer;
+}
+
+// Число дней от 1970-01-01 до даты по григорианскому календарю (UTC)
+inline int64_t daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Дата для заголовков HTTP: "Sun, 06 Nov 1994 08:49:37 GMT"
+inline std::string formatHttpDate(int64_t ms) {
+    static const char* const days[] = { "Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed" };
+    static const char* const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                          "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    int64_t seconds = ms >= 0 ? ms / 1000 : (ms - 999) / 1000;
+    int64_t days_since_epoch = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+    int64_t second_of_day = seconds - days_since_epoch * 86400;
+
+    // Обратное к daysFromCivil
+    int64_t z = days_since_epoch + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    int month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    int year = static_cast<int>(yoe + era * 400 + (month <= 2));
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+             days[((days_since_epoch % 7) + 7) % 7], day, months[month - 1], year,
+             static_cast<int>(second_of_day / 3600), static_cast<int>(second_of_day / 60 % 60),
+             static_cast<int>(second_of_day % 60));
+    return buffer;
+}
+
+// Разбор даты в формате formatHttpDate, результат - секунды от эпохи
+inline bool parseHttpDate(const std::string& str, int64_t& seconds) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    if (str.size() < 29 || str[3] != ',' || str[4] != ' ') return false;
+
+    const char* p = str.c_str() + 5;
+    const char* end = str.c_str() + str.size();
+    int day, year, hour, minute, second;
+
+    if (!parseDigits(p, end, 2, day) || *p++ != ' ') return false;
+
+    int month = 0;
+    while (month < 12 && str.compare(p - str.c_str(), 3, months + month * 3, 3) != 0) ++month;
+    if (month == 12) return false;
+    p += 3;
+
+    if (*p++ != ' ' || !parseDigits(p, end, 4, year) || *p++ != ' ') return false;
+    if (!parseDigits(p, end, 2, hour) || *p++ != ':') return false;
+    if (!parseDigits(p, end, 2, minute) || *p++ != ':') return false;
+    if (!parseDigits(p, end, 2, second)) return false;
+
+    seconds = daysFromCivil(year, month + 1, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+// Пул потоков с двумя очередями: быстрые задачи (последний замер) берутся
+// первыми, медленные (выборки по диапазону) никогда не занимают все потоки,
+// чтобы быстрым всегда оставался свободный исполнитель.
+// Обе очереди ограничены: если места нет, submit() сразу возвращает false
+class WorkerPool {
+public:
+    enum Priority {
+        PRIORITY_FAST,
+        PRIORITY_SLOW
+    };
+
+    typedef std::function<void()> Task;
+
+    WorkerPool() : queue_depth(0), slow_limit(0), slow_running(0), running(false) {}
+
+    ~WorkerPool() {
+        stop();
+    }
+
+    bool start(size_t threads, size_t depth) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (running) return true;
+        if (threads == 0 || depth == 0) return false;
+
+        queue_depth = depth;
+        slow_limit = threads > 1 ? threads - 1 : 1;
+        slow_running = 0;
+        running = true;
+
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+        return true;
+    }
+
+    // Ждет завершения выполняемых задач, невыполненные выбрасывает
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running) return;
+            running = false;
+            fast_queue.clear();
+            slow_queue.clear();
+        }
+        wakeup.notify_all();
+
+        for (auto& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+        workers.clear();
+    }
+
+    bool submit(Priority priority, Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::deque<Task>& queue = priority == PRIORITY_FAST ? fast_queue : slow_queue;
+            if (!running || queue.size() >= queue_depth) return false;
+            queue.push_back(std::move(task));
+        }
+        wakeup.notify_one();
+        return true;
+    }
+
+private:
+    bool hasWork() const {
+        return !fast_queue.empty() || (!slow_queue.empty() && slow_running < slow_limit);
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;) {
+            wakeup.wait(lock, [this]() { return !running || hasWork(); });
+            if (!running) return;
+
+            bool slow = fast_queue.empty();
+            std::deque<Task>& queue = slow ? slow_queue : fast_queue;
+            Task task = std::move(queue.front());
+            queue.pop_front();
+            if (slow) ++slow_running;
+
+            lock.unlock();
+            task();
+            lock.lock();
+
+            if (slow) {
+                --slow_running;
+                // Освободилось место для медленной задачи
+                if (!slow_queue.empty()) wakeup.notify_one();
+            }
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<Task> fast_queue;
+    std::deque<Task> slow_queue;
+    std::vector<std::thread> workers;
+    size_t queue_depth;
+    size_t slow_limit;      // сколько потоков могут одновременно выполнять медленные задачи
+    size_t slow_running;
+    bool running;
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif